@@ -0,0 +1,551 @@
+// Benchmarks for the DSP kernels in plugin.cpp.
+// Build on Linux with: g++ -O2 -mavx2 -mfma -o benchmark benchmark.cpp -lX11
+
+#include "plugin.cpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#define BENCHMARK_VOICES (64)
+#define BENCHMARK_FRAMES (48000)
+#define BENCHMARK_BLOCK_SIZE (512)
+#define BENCHMARK_PROCESS_FRAMES (BENCHMARK_FRAMES / BENCHMARK_BLOCK_SIZE * BENCHMARK_BLOCK_SIZE) // Rendered into each channel by BenchmarkPluginProcess, in whole blocks.
+#define BENCHMARK_POOL_THREADS (7) // Worker threads in the stand-in host thread pool, besides the audio thread.
+
+static const char *sineKernelNames[SINE_KERNEL_COUNT] = {
+	"POLYNOMIAL_5",
+	"POLYNOMIAL_9",
+	"TABLE",
+};
+
+static float benchmarkOutput[BENCHMARK_FRAMES];
+static float benchmarkOutputR[BENCHMARK_FRAMES];
+static float benchmarkGain[BENCHMARK_FRAMES];
+static float benchmarkCutoff[BENCHMARK_FRAMES];
+static float benchmarkFilterTable[FILTER_TABLE_SIZE + 2];
+
+static void BenchmarkLibmSine(VoicePool *pool, uint32_t first, const VoiceRenderInputs *inputs, float *output, float *, uint32_t frameCount) {
+	// The original scalar loop, for comparison. The envelopes are held at their sustain level.
+	float *phases = pool->phase + first;
+
+	for (uint32_t index = 0; index < frameCount; index++) {
+		for (uint32_t i = 0; i < VOICE_GROUP_SIZE; i++) {
+			output[index] += sinf(phases[i] * 2.0f * 3.14159f) * pool->volume[first + i] * inputs->gain[index];
+			phases[i] += pool->increment[first + i];
+			phases[i] -= floorf(phases[i]);
+		}
+	}
+}
+
+static void BenchmarkFilterInputs(VoiceRenderInputs *inputs, uint32_t filterMode) {
+	// A low-pass filter at 1.28 kHz with its cutoff swept by the envelope, so the coefficients change every chunk.
+	FilterTableBuild(benchmarkFilterTable, 48000.0f);
+
+	for (uint32_t i = 0; i < BENCHMARK_FRAMES; i++) {
+		benchmarkCutoff[i] = 0.6f;
+	}
+
+	inputs->filterMode = filterMode;
+	inputs->flags = filterMode != FILTER_OFF ? RENDER_FILTERED : 0;
+	inputs->cutoff = benchmarkCutoff;
+	inputs->filterTable = benchmarkFilterTable;
+	inputs->modulation[MODULATION_DESTINATION_CUTOFF][MODULATION_SOURCE_ENVELOPE] = 0.2f;
+	inputs->filterDamping = 1.0f;
+	inputs->filterMix[2] = 1.0f;
+}
+
+static double BenchmarkVoiceGroupRenderer(VoiceGroupRenderer renderer, uint32_t waveform, uint32_t voiceCount, uint32_t filterMode) {
+	VoicePool pool = {};
+	VoicePoolAllocate(&pool, voiceCount);
+	pool.count = voiceCount;
+
+	for (uint32_t i = 0; i < voiceCount; i++) {
+		pool.increment[i] = 440.0f * exp2f((i % 64 + 24 - 57.0f) / 12.0f) / 48000.0f;
+		pool.volume[i] = 0.1f;
+		pool.wavetableOffset[i] = 4 * WAVETABLE_STRIDE;
+		pool.envelopeLevel[i] = 1.0f;
+		pool.envelopeStage[i] = ENVELOPE_SUSTAIN;
+	}
+
+	VoiceRenderInputs inputs = {};
+	inputs.gain = benchmarkGain;
+	inputs.envelope[0].sustain = inputs.envelope[1].sustain = 1.0f;
+	inputs.wavetable = WavetablesAcquire() + waveform * WAVETABLE_LEVELS * WAVETABLE_STRIDE;
+	BenchmarkFilterInputs(&inputs, filterMode);
+
+	for (uint32_t i = 0; i < BENCHMARK_FRAMES; i++) {
+		benchmarkGain[i] = 1.0f;
+	}
+
+	double best = 1e30;
+
+	for (uintptr_t run = 0; run < 10; run++) {
+		uint64_t start = __rdtsc();
+
+		for (uint32_t i = 0; i < voiceCount; i += VOICE_GROUP_SIZE) {
+			renderer(&pool, i, &inputs, benchmarkOutput, benchmarkOutputR, BENCHMARK_FRAMES);
+		}
+
+		double cycles = (double) (__rdtsc() - start) / BENCHMARK_FRAMES / voiceCount;
+		if (cycles < best) best = cycles;
+	}
+
+	VoicePoolFree(&pool);
+	WavetablesRelease();
+	return best;
+}
+
+static double BenchmarkSineError(int kernel) {
+	double maximum = 0.0;
+
+	for (uint32_t i = 0; i < (1 << 20); i += SIMD_WIDTH) {
+		float phases[SIMD_WIDTH], results[SIMD_WIDTH];
+		for (uint32_t j = 0; j < SIMD_WIDTH; j++) phases[j] = (float) (i + j) / (1 << 20);
+
+		SIMDFloat phase = SIMDLoad(phases);
+		if (kernel == SINE_KERNEL_POLYNOMIAL_5) SIMDStore(results, OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(phase));
+		else if (kernel == SINE_KERNEL_POLYNOMIAL_9) SIMDStore(results, OscillatorSine<SINE_KERNEL_POLYNOMIAL_9>(phase));
+		else if (kernel == SINE_KERNEL_TABLE) SIMDStore(results, OscillatorSine<SINE_KERNEL_TABLE>(phase));
+		else for (uint32_t j = 0; j < SIMD_WIDTH; j++) results[j] = sinf(phases[j] * 2.0f * 3.14159f);
+
+		for (uint32_t j = 0; j < SIMD_WIDTH; j++) {
+			double error = fabs(results[j] - sin(2.0 * 3.14159265358979 * phases[j]));
+			if (error > maximum) maximum = error;
+		}
+	}
+
+	return maximum;
+}
+
+static void BenchmarkSineKernels() {
+	printf("Sine kernels (%d lanes, %d voices):\n", SIMD_WIDTH, BENCHMARK_VOICES);
+	printf("    %-16s%-14s%s\n", "kernel", "max error", "cycles/sample/voice");
+
+	for (int i = 0; i < SINE_KERNEL_COUNT; i++) {
+		printf("    %-16s%-14.2e%.2f\n", sineKernelNames[i], BenchmarkSineError(i), BenchmarkVoiceGroupRenderer(voiceGroupRenderers[i][0], WAVEFORM_SINE, BENCHMARK_VOICES, FILTER_OFF));
+	}
+
+	printf("    %-16s%-14.2e%.2f\n", "(libm sinf)", BenchmarkSineError(-1), BenchmarkVoiceGroupRenderer(BenchmarkLibmSine, WAVEFORM_SINE, BENCHMARK_VOICES, FILTER_OFF));
+	printf("    %-16s%-14s%.2f\n", "(saw wavetable)", "", BenchmarkVoiceGroupRenderer(voiceGroupRenderers[OSCILLATOR_WAVETABLE][0], WAVEFORM_SAW, BENCHMARK_VOICES, FILTER_OFF));
+}
+
+static void BenchmarkFilterPolyphony() {
+	printf("Filter (%d lanes, saw wavetable):\n", SIMD_WIDTH);
+	printf("    %-16s%-24s%s\n", "voices", "off cycles/sample/voice", "low-pass cycles/sample/voice");
+	static const uint32_t counts[] = { 16, 64, 256 };
+
+	for (uint32_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		printf("    %-16u%-24.2f%.2f\n", counts[i], 
+				BenchmarkVoiceGroupRenderer(voiceGroupRenderers[OSCILLATOR_WAVETABLE][0], WAVEFORM_SAW, counts[i], FILTER_OFF),
+				BenchmarkVoiceGroupRenderer(voiceGroupRenderers[OSCILLATOR_WAVETABLE][RENDER_FILTERED], WAVEFORM_SAW, counts[i], FILTER_LOW_PASS));
+	}
+}
+
+static double BenchmarkUnison(VoiceGroupRenderer renderer, uint32_t waveform, uint32_t unisonCount) {
+	VoicePool pool = {};
+	VoicePoolAllocate(&pool, BENCHMARK_VOICES);
+	pool.count = BENCHMARK_VOICES;
+
+	for (uint32_t i = 0; i < BENCHMARK_VOICES; i++) {
+		pool.increment[i] = 440.0f * exp2f((i + 24 - 57.0f) / 12.0f) / 48000.0f;
+		pool.volume[i] = 0.1f;
+		pool.wavetableOffset[i] = 4 * WAVETABLE_STRIDE;
+		pool.envelopeLevel[i] = 1.0f;
+		pool.envelopeStage[i] = ENVELOPE_SUSTAIN;
+		VoicePoolSetUnison(&pool, i, unisonCount, 0.2f, 0.5f);
+	}
+
+	VoiceRenderInputs inputs = {};
+	inputs.gain = benchmarkGain;
+	inputs.envelope[0].sustain = inputs.envelope[1].sustain = 1.0f;
+	inputs.wavetable = WavetablesAcquire() + waveform * WAVETABLE_LEVELS * WAVETABLE_STRIDE;
+	inputs.unisonCount = unisonCount;
+	BenchmarkFilterInputs(&inputs, FILTER_OFF);
+
+	for (uint32_t i = 0; i < BENCHMARK_FRAMES; i++) {
+		benchmarkGain[i] = 1.0f;
+	}
+
+	double best = 1e30;
+
+	for (uintptr_t run = 0; run < 10; run++) {
+		uint64_t start = __rdtsc();
+
+		for (uint32_t i = 0; i < BENCHMARK_VOICES; i += VOICE_GROUP_SIZE) {
+			renderer(&pool, i, &inputs, benchmarkOutput, benchmarkOutputR, BENCHMARK_FRAMES);
+		}
+
+		// Reported per unison voice, i.e. per note, not per sub-oscillator.
+		double cycles = (double) (__rdtsc() - start) / BENCHMARK_FRAMES / BENCHMARK_VOICES;
+		if (cycles < best) best = cycles;
+	}
+
+	VoicePoolFree(&pool);
+	WavetablesRelease();
+	return best;
+}
+
+static void BenchmarkUnisonCounts() {
+	printf("Unison (%d lanes, %d voices):\n", SIMD_WIDTH, BENCHMARK_VOICES);
+	printf("    %-16s%-24s%s\n", "sub-oscillators", "saw cycles/sample/voice", "sine cycles/sample/voice");
+	static const uint32_t counts[] = { 7, 9, 16 };
+
+	for (uint32_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		printf("    %-16u%-24.2f%.2f\n", counts[i], 
+				BenchmarkUnison(unisonGroupRenderers[OSCILLATOR_WAVETABLE][0], WAVEFORM_SAW, counts[i]),
+				BenchmarkUnison(unisonGroupRenderers[SINE_KERNEL_DEFAULT][0], WAVEFORM_SINE, counts[i]));
+	}
+}
+
+static double BenchmarkConvolver(Convolver *convolver, const ConvolverImpulse *impulse) {
+	// Returns the cycles per sample to convolve a block of noise.
+	uint32_t blockSize = convolver->blockSize, blockCount = BENCHMARK_FRAMES / blockSize + 1;
+	double best = 1e30;
+
+	for (uint32_t i = 0; i < blockSize; i++) {
+		benchmarkGain[i] = (float) rand() / RAND_MAX - 0.5f;
+	}
+
+	for (uintptr_t run = 0; run < 5; run++) {
+		uint64_t start = __rdtsc();
+
+		for (uint32_t i = 0; i < blockCount; i++) {
+			ConvolverProcess(convolver, impulse, benchmarkGain, benchmarkOutput, benchmarkOutputR);
+		}
+
+		double cycles = (double) (__rdtsc() - start) / (blockCount * blockSize);
+		if (cycles < best) best = cycles;
+	}
+
+	return best;
+}
+
+static void BenchmarkReverb() {
+	// The reverb thread is idle, since nothing is submitted to it, so its convolver can be timed here.
+	printf("Convolution reverb (48 kHz, %d lanes):\n", SIMD_WIDTH);
+	printf("    %-16s%-32s%s\n", "length", "audio thread cycles/sample", "reverb thread cycles/sample");
+	static const float lengths[] = { 1.0f, 4.0f, 10.0f };
+
+	for (uint32_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+		Reverb *reverb = (Reverb *) calloc(1, sizeof(Reverb));
+		ReverbStart(reverb, 48000.0f, lengths[i]);
+		printf("    %-16.0f%-32.2f%.2f\n", lengths[i], 
+				BenchmarkConvolver(&reverb->head, &reverb->impulses[0].head), 
+				BenchmarkConvolver(&reverb->tail, &reverb->impulses[0].tail));
+		ReverbStop(reverb);
+		free(reverb);
+	}
+}
+
+// A stand-in for a host's thread pool. request_exec wakes the workers, and the calling thread takes tasks alongside them until all have run.
+struct BenchmarkThreadPool {
+	const clap_plugin_t *plugin;
+	const clap_plugin_thread_pool_t *extension;
+	std::atomic<uint32_t> nextTask;
+	uint32_t taskCount;
+	Thread threads[BENCHMARK_POOL_THREADS];
+	Semaphore start, done;
+	std::atomic<bool> quit;
+};
+
+static BenchmarkThreadPool benchmarkThreadPool;
+
+static void BenchmarkThreadPoolRunTasks() {
+	uint32_t task;
+
+	while ((task = benchmarkThreadPool.nextTask.fetch_add(1, std::memory_order_relaxed)) < benchmarkThreadPool.taskCount) {
+		benchmarkThreadPool.extension->exec(benchmarkThreadPool.plugin, task);
+	}
+}
+
+static void *BenchmarkThreadPoolWorker(void *) {
+	while (true) {
+		SemaphoreWait(benchmarkThreadPool.start);
+		if (benchmarkThreadPool.quit.load(std::memory_order_acquire)) break;
+		BenchmarkThreadPoolRunTasks();
+		SemaphorePost(benchmarkThreadPool.done);
+	}
+
+	return nullptr;
+}
+
+static const clap_host_thread_pool_t benchmarkHostThreadPool = {
+	.request_exec = [] (const clap_host_t *host, uint32_t taskCount) -> bool {
+		benchmarkThreadPool.taskCount = taskCount;
+		benchmarkThreadPool.nextTask.store(0, std::memory_order_relaxed);
+		for (uint32_t i = 0; i < BENCHMARK_POOL_THREADS; i++) SemaphorePost(benchmarkThreadPool.start);
+		BenchmarkThreadPoolRunTasks();
+		for (uint32_t i = 0; i < BENCHMARK_POOL_THREADS; i++) SemaphoreWait(benchmarkThreadPool.done);
+		return true;
+	},
+};
+
+static void BenchmarkThreadPoolStart() {
+	SemaphoreInitialise(benchmarkThreadPool.start);
+	SemaphoreInitialise(benchmarkThreadPool.done);
+	for (uint32_t i = 0; i < BENCHMARK_POOL_THREADS; i++) ThreadStart(benchmarkThreadPool.threads[i], BenchmarkThreadPoolWorker, nullptr);
+}
+
+static void BenchmarkThreadPoolStop() {
+	benchmarkThreadPool.quit.store(true, std::memory_order_release);
+	for (uint32_t i = 0; i < BENCHMARK_POOL_THREADS; i++) SemaphorePost(benchmarkThreadPool.start);
+	for (uint32_t i = 0; i < BENCHMARK_POOL_THREADS; i++) ThreadJoin(benchmarkThreadPool.threads[i]);
+	SemaphoreDestroy(benchmarkThreadPool.start);
+	SemaphoreDestroy(benchmarkThreadPool.done);
+}
+
+static uint32_t benchmarkTailBlocksMissed; // By the reverb, in the last call to BenchmarkPluginProcess.
+static clap_event_note_t benchmarkNotes[VOICE_POOL_CAPACITY];
+static uint32_t benchmarkNoteCount;
+
+static const clap_input_events_t benchmarkInputEvents = {
+	.ctx = nullptr,
+	.size = [] (const clap_input_events_t *list) -> uint32_t { return benchmarkNoteCount; },
+	.get = [] (const clap_input_events_t *list, uint32_t index) -> const clap_event_header_t * { return &benchmarkNotes[index].header; },
+};
+
+static const clap_output_events_t benchmarkOutputEvents = {
+	.ctx = nullptr,
+	.try_push = [] (const clap_output_events_t *list, const clap_event_header_t *event) -> bool { return true; },
+};
+
+static double BenchmarkPluginProcess(bool threadPool, bool offline, uint32_t voiceCount, uint32_t unisonCount, float reverbMix, float *output) {
+	// Plays voiceCount held saw notes through a plugin instance, and returns the cycles per sample taken by process.
+	// The host only offers the thread pool extension if threadPool is set.
+	clap_host_t host = {};
+	host.clap_version = CLAP_VERSION_INIT;
+	host.host_data = (void *) threadPool;
+	host.get_extension = [] (const clap_host_t *host, const char *id) -> const void * {
+		return host->host_data && 0 == strcmp(id, CLAP_EXT_THREAD_POOL) ? &benchmarkHostThreadPool : nullptr;
+	};
+
+	const clap_plugin_t *plugin = pluginFactory.create_plugin(&pluginFactory, &host, pluginDescriptor.id);
+	plugin->init(plugin);
+	const clap_plugin_render_t *render = (const clap_plugin_render_t *) plugin->get_extension(plugin, CLAP_EXT_RENDER);
+	render->set(plugin, offline ? CLAP_RENDER_OFFLINE : CLAP_RENDER_REALTIME);
+	plugin->activate(plugin, 48000.0, 1, BENCHMARK_BLOCK_SIZE);
+	benchmarkThreadPool.plugin = plugin;
+	benchmarkThreadPool.extension = (const clap_plugin_thread_pool_t *) plugin->get_extension(plugin, CLAP_EXT_THREAD_POOL);
+
+	MyPlugin *instance = (MyPlugin *) plugin->plugin_data;
+	PluginApplyParameter(instance, P_WAVEFORM, WAVEFORM_SAW, 0);
+	PluginApplyParameter(instance, P_UNISON_VOICES, unisonCount, 0);
+	PluginApplyParameter(instance, P_VOLUME, 0.1f, 0);
+	PluginApplyParameter(instance, P_REVERB_MIX, reverbMix, 0);
+	PluginSnapRamps(instance);
+
+	for (uint32_t i = 0; i < voiceCount; i++) {
+		clap_event_note_t *note = &benchmarkNotes[i];
+		*note = {};
+		note->header.size = sizeof(clap_event_note_t);
+		note->header.type = CLAP_EVENT_NOTE_ON;
+		note->note_id = i;
+		note->key = 24 + i % 96;
+		note->channel = i / 96;
+		note->velocity = 1.0;
+	}
+
+	clap_audio_buffer_t buffer = {};
+	float *data[2] = { output, output + BENCHMARK_FRAMES };
+	buffer.data32 = data;
+	buffer.channel_count = 2;
+	clap_process_t process = {};
+	process.frames_count = BENCHMARK_BLOCK_SIZE;
+	process.audio_outputs = &buffer;
+	process.audio_outputs_count = 1;
+	process.in_events = &benchmarkInputEvents;
+	process.out_events = &benchmarkOutputEvents;
+
+	uint32_t blockCount = BENCHMARK_PROCESS_FRAMES / BENCHMARK_BLOCK_SIZE;
+	uint64_t start = __rdtsc();
+
+	for (uint32_t i = 0; i < blockCount; i++) {
+		benchmarkNoteCount = i ? 0 : voiceCount;
+		data[0] = output + i * BENCHMARK_BLOCK_SIZE, data[1] = data[0] + BENCHMARK_FRAMES;
+		plugin->process(plugin, &process);
+	}
+
+	double cycles = (double) (__rdtsc() - start) / (blockCount * BENCHMARK_BLOCK_SIZE);
+	benchmarkTailBlocksMissed = instance->reverb.tailBlocksMissed.load();
+	plugin->deactivate(plugin);
+	plugin->destroy(plugin);
+	return cycles;
+}
+
+static void BenchmarkThreadPoolRendering() {
+	// The cycles are counted on the audio thread, so they measure how long the host waits for each block.
+	// With a single processor the plugin does not use the pool, so both columns render serially.
+	printf("Rendering on a thread pool (%d lanes, %d workers, %d processors, 7 sub-oscillator saw), wall-clock cycles/sample:\n",
+			SIMD_WIDTH, BENCHMARK_POOL_THREADS, (int) ProcessorCount());
+	printf("    %-16s%-16s%-16s%-16s%s\n", "voices", "serial", "thread pool", "speedup", "max difference");
+	static const uint32_t voiceCounts[] = { 64, 128, 256 };
+	float *serial = (float *) calloc(2 * BENCHMARK_FRAMES, sizeof(float));
+	float *pooled = (float *) calloc(2 * BENCHMARK_FRAMES, sizeof(float));
+	BenchmarkThreadPoolStart();
+
+	for (uint32_t i = 0; i < sizeof(voiceCounts) / sizeof(voiceCounts[0]); i++) {
+		double serialCycles = BenchmarkPluginProcess(false, false, voiceCounts[i], 7, 0.0f, serial);
+		double pooledCycles = BenchmarkPluginProcess(true, false, voiceCounts[i], 7, 0.0f, pooled);
+		float difference = 0.0f;
+
+		for (uint32_t channel = 0; channel < 2; channel++) {
+			for (uint32_t j = channel * BENCHMARK_FRAMES; j < channel * BENCHMARK_FRAMES + BENCHMARK_PROCESS_FRAMES; j++) {
+				difference = fmaxf(difference, fabsf(serial[j] - pooled[j]));
+			}
+		}
+		printf("    %-16u%-16.2f%-16.2f%-16.2f%.3g\n", voiceCounts[i], serialCycles, pooledCycles, serialCycles / pooledCycles, difference);
+	}
+
+	BenchmarkThreadPoolStop();
+	free(serial);
+	free(pooled);
+}
+
+static void BenchmarkOfflineRendering() {
+	// The same notes, with the reverb on, rendered in realtime mode and then offline by a host without a thread pool.
+	// Offline, the plugin waits for the reverb thread instead of dropping its late blocks, and with more than one processor starts its own workers for the voices.
+	// The block sizes are the same in both modes, so on a single processor the ratio only shows the cost of waiting.
+	printf("Offline rendering (%d lanes, %d workers, %d processors, 7 sub-oscillator saw, reverb mix 0.3), wall-clock cycles/sample:\n",
+			SIMD_WIDTH, RENDER_TASK_COUNT - 1, (int) ProcessorCount());
+	printf("    %-16s%-16s%-16s%-16s%-24s%s\n", "voices", "realtime", "offline", "ratio", "realtime late blocks", "offline repeatable");
+	static const uint32_t voiceCounts[] = { 64, 256 };
+	float *realtime = (float *) calloc(2 * BENCHMARK_FRAMES, sizeof(float));
+	float *offline = (float *) calloc(2 * BENCHMARK_FRAMES, sizeof(float));
+	float *offlineAgain = (float *) calloc(2 * BENCHMARK_FRAMES, sizeof(float));
+
+	for (uint32_t i = 0; i < sizeof(voiceCounts) / sizeof(voiceCounts[0]); i++) {
+		double realtimeCycles = BenchmarkPluginProcess(false, false, voiceCounts[i], 7, 0.3f, realtime);
+		uint32_t realtimeMissed = benchmarkTailBlocksMissed;
+		double offlineCycles = BenchmarkPluginProcess(false, true, voiceCounts[i], 7, 0.3f, offline);
+		BenchmarkPluginProcess(false, true, voiceCounts[i], 7, 0.3f, offlineAgain);
+		bool repeatable = 0 == memcmp(offline, offlineAgain, BENCHMARK_PROCESS_FRAMES * sizeof(float))
+			&& 0 == memcmp(offline + BENCHMARK_FRAMES, offlineAgain + BENCHMARK_FRAMES, BENCHMARK_PROCESS_FRAMES * sizeof(float));
+		printf("    %-16u%-16.2f%-16.2f%-16.2f%-24u%s\n", voiceCounts[i], realtimeCycles, offlineCycles, 
+				realtimeCycles / offlineCycles, realtimeMissed, repeatable ? "yes" : "no");
+	}
+
+	free(realtime);
+	free(offline);
+	free(offlineAgain);
+}
+
+#define BENCHMARK_EXPRESSION_FRAMES (256)
+
+static const clap_event_header_t *benchmarkEvents[16];
+static uint32_t benchmarkEventCount;
+
+static const clap_input_events_t benchmarkEventList = {
+	.ctx = nullptr,
+	.size = [] (const clap_input_events_t *list) -> uint32_t { return benchmarkEventCount; },
+	.get = [] (const clap_input_events_t *list, uint32_t index) -> const clap_event_header_t * { return benchmarkEvents[index]; },
+};
+
+static void BenchmarkExpressionRender(bool split, float *output) {
+	// Plays two sine notes with several expressions each in one block. If split is set, the block is processed in pieces
+	// starting at each expression's chunk, so that every piece holds at most one value of each expression for each voice.
+	static const struct { int16_t key; clap_note_expression expression; uint32_t time; double value; } expressions[] = {
+		{ 60, CLAP_NOTE_EXPRESSION_VOLUME, 5, 0.5 }, { 67, CLAP_NOTE_EXPRESSION_PAN, 10, 0.0 }, { 60, CLAP_NOTE_EXPRESSION_VOLUME, 40, 2.0 },
+		{ 67, CLAP_NOTE_EXPRESSION_PAN, 50, 1.0 }, { 60, CLAP_NOTE_EXPRESSION_TUNING, 60, 2.0 }, { 60, CLAP_NOTE_EXPRESSION_VOLUME, 100, 0.25 },
+		{ 60, CLAP_NOTE_EXPRESSION_TUNING, 130, -3.0 }, { 67, CLAP_NOTE_EXPRESSION_PAN, 180, 0.3 }, { 60, CLAP_NOTE_EXPRESSION_VOLUME, 200, 1.5 },
+	};
+	const uint32_t expressionCount = sizeof(expressions) / sizeof(expressions[0]);
+
+	clap_host_t host = {};
+	host.clap_version = CLAP_VERSION_INIT;
+	host.get_extension = [] (const clap_host_t *host, const char *id) -> const void * { return nullptr; };
+	const clap_plugin_t *plugin = pluginFactory.create_plugin(&pluginFactory, &host, pluginDescriptor.id);
+	plugin->init(plugin);
+	plugin->activate(plugin, 48000.0, 1, BENCHMARK_EXPRESSION_FRAMES);
+	MyPlugin *instance = (MyPlugin *) plugin->plugin_data;
+	PluginApplyParameter(instance, P_WAVEFORM, WAVEFORM_SINE, 0);
+	PluginApplyParameter(instance, P_VOLUME, 0.1f, 0);
+	PluginSnapRamps(instance);
+
+	clap_event_note_t notes[2] = {};
+	clap_event_note_expression_t events[expressionCount] = {};
+
+	for (uint32_t i = 0; i < 2; i++) {
+		notes[i].header.size = sizeof(clap_event_note_t);
+		notes[i].header.type = CLAP_EVENT_NOTE_ON;
+		notes[i].note_id = -1;
+		notes[i].key = i ? 67 : 60;
+		notes[i].velocity = 1.0;
+	}
+
+	clap_audio_buffer_t buffer = {};
+	float *data[2];
+	buffer.data32 = data;
+	buffer.channel_count = 2;
+	clap_process_t process = {};
+	process.audio_outputs = &buffer;
+	process.audio_outputs_count = 1;
+	process.in_events = &benchmarkEventList;
+	process.out_events = &benchmarkOutputEvents;
+
+	for (uint32_t start = 0, next = 0; start < BENCHMARK_EXPRESSION_FRAMES; start = next) {
+		next = BENCHMARK_EXPRESSION_FRAMES;
+
+		for (uint32_t i = 0; i < expressionCount && split; i++) {
+			uint32_t chunk = expressions[i].time / ENVELOPE_CHUNK * ENVELOPE_CHUNK;
+			if (chunk > start && chunk < next) next = chunk;
+		}
+
+		benchmarkEventCount = 0;
+
+		for (uint32_t i = 0; i < 2 && !start; i++) {
+			benchmarkEvents[benchmarkEventCount++] = &notes[i].header;
+		}
+
+		for (uint32_t i = 0; i < expressionCount; i++) {
+			if (expressions[i].time < start || expressions[i].time >= next) continue;
+			clap_event_note_expression_t *event = &events[i];
+			event->header.size = sizeof(clap_event_note_expression_t);
+			event->header.type = CLAP_EVENT_NOTE_EXPRESSION;
+			event->header.time = expressions[i].time - start;
+			event->expression_id = expressions[i].expression;
+			event->note_id = -1;
+			event->channel = 0;
+			event->key = expressions[i].key;
+			event->value = expressions[i].value;
+			benchmarkEvents[benchmarkEventCount++] = &event->header;
+		}
+
+		data[0] = output + start, data[1] = output + BENCHMARK_EXPRESSION_FRAMES + start;
+		process.frames_count = next - start;
+		plugin->process(plugin, &process);
+	}
+
+	plugin->deactivate(plugin);
+	plugin->destroy(plugin);
+}
+
+static void BenchmarkExpressionTiming() {
+	// Checks that each note expression takes effect in the envelope chunk containing it, when a voice gets several in one block.
+	float whole[2 * BENCHMARK_EXPRESSION_FRAMES], split[2 * BENCHMARK_EXPRESSION_FRAMES];
+	BenchmarkExpressionRender(false, whole);
+	BenchmarkExpressionRender(true, split);
+	float difference = 0.0f;
+
+	for (uint32_t i = 0; i < 2 * BENCHMARK_EXPRESSION_FRAMES; i++) {
+		difference = fmaxf(difference, fabsf(whole[i] - split[i]));
+	}
+
+	printf("Note expression timing (2 voices, 9 expressions in a %d frame block), max difference from one block per chunk: %g, %s\n",
+			BENCHMARK_EXPRESSION_FRAMES, difference, difference == 0.0f ? "pass" : "FAIL");
+}
+
+int main(int argc, char **argv) {
+	clap_entry.init("");
+	BenchmarkExpressionTiming();
+	BenchmarkSineKernels();
+	BenchmarkFilterPolyphony();
+	BenchmarkUnisonCounts();
+	BenchmarkReverb();
+	BenchmarkThreadPoolRendering();
+	BenchmarkOfflineRendering();
+	clap_entry.deinit();
+	return 0;
+}
@@ -0,0 +1,725 @@
+// A headless CLAP host for measuring plugin.cpp without a DAW, audio device or GUI.
+// It loads the plugin, plays a scripted stream of note and parameter events through process() as fast as it can,
+// and reports the realtime factor, per-block processing time percentiles and the most voices playing at once.
+// Build on Linux with: g++ -O2 -o host host.cpp -ldl
+// Run with: ./host HelloCLAP.clap [options], or ./host --help for the options.
+// For a realtime sanitizer build, add -DRT_SANITIZER -rdynamic here and -DRT_SANITIZER to the plugin's build.
+// Any allocation, mutex lock, blocking wait or file operation made on a thread the plugin has marked realtime is then reported with a backtrace,
+// and the host exits with status 2 if there were any. With --offline, blocking waits are allowed, since the plugin waits for its workers by design.
+// ./host --sanitizer-test checks that each kind of call is reported, by making them on a thread marked realtime.
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "clap/clap.h"
+
+#ifdef RT_SANITIZER
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <execinfo.h>
+#include <atomic>
+#endif
+
+#define HOST_MAXIMUM_RUNS (16) // Of each of block sizes and sample rates.
+#define HOST_MAXIMUM_SETTINGS (64)
+#define HOST_MAXIMUM_BLOCK_EVENTS (4096)
+
+#define SCRIPT_NOTE_ON (0)
+#define SCRIPT_NOTE_OFF (1)
+#define SCRIPT_PARAMETER (2)
+
+struct ScriptEvent {
+	double time; // In seconds.
+	uint32_t type;
+	int16_t key;
+	clap_id parameter;
+	double value; // The velocity of a note, or the value of a parameter.
+	uint32_t order; // The position in the script, to keep events at the same time in order when sorting.
+};
+
+struct Script {
+	ScriptEvent *events;
+	uint32_t count, capacity;
+	double length; // In seconds.
+};
+
+struct HostSetting {
+	const char *name;
+	double value;
+};
+
+struct HostOptions {
+	const char *pluginPath;
+	const char *scriptPath;
+	uint32_t blockSizes[HOST_MAXIMUM_RUNS], blockSizeCount;
+	uint32_t sampleRates[HOST_MAXIMUM_RUNS], sampleRateCount;
+	double seconds;
+	uint32_t notesPerBeat;
+	double holdTime;
+	bool offline;
+	uint32_t dialect; // The note dialect the script's notes are sent in: CLAP_NOTE_DIALECT_CLAP, _MIDI or _MIDI2.
+	HostSetting settings[HOST_MAXIMUM_SETTINGS];
+	uint32_t settingCount;
+};
+
+struct HostBlockEvents {
+	union {
+		clap_event_header_t header;
+		clap_event_note_t note;
+		clap_event_param_value_t parameter;
+		clap_event_midi_t midi;
+		clap_event_midi2_t midi2;
+	} events[HOST_MAXIMUM_BLOCK_EVENTS];
+
+	uint32_t count;
+	uint32_t voicesEnded; // NOTE_END events sent by the plugin.
+};
+
+static const clap_host_t host = {
+	.clap_version = CLAP_VERSION_INIT,
+	.host_data = nullptr,
+	.name = "Headless benchmark host",
+	.vendor = "nakst",
+	.url = "https://nakst.gitlab.io",
+	.version = "1.0.0",
+
+	// The host offers no extensions, so the plugin runs as it would without a GUI, timers or a thread pool.
+	.get_extension = [] (const clap_host_t *host, const char *id) -> const void * { return nullptr; },
+	.request_restart = [] (const clap_host_t *host) {},
+	.request_process = [] (const clap_host_t *host) {},
+	.request_callback = [] (const clap_host_t *host) {},
+};
+
+#ifdef RT_SANITIZER
+// The sanitizer interposes the functions below over the C library's, which works because the executable comes first in the symbol lookup order.
+// The plugin calls RealtimeSanitizerEnter and RealtimeSanitizerLeave around process, flush and render tasks, which can nest.
+
+#define SANITIZER_MAXIMUM_REPORTS (16) // After this, violations are only counted.
+#define SANITIZER_MAXIMUM_FRAMES (32)
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void __libc_free(void *pointer);
+
+static __thread uint32_t sanitizerDepth;
+static __thread bool sanitizerReporting; // Set while reporting, so the report's own output isn't reported.
+static std::atomic<uint32_t> sanitizerViolations;
+static bool sanitizerAllowBlocking; // Set for offline runs, where waiting is not a violation.
+static const char *sanitizerFirstReported; // The function of the first violation since it was last cleared, for --sanitizer-test.
+
+extern "C" void RealtimeSanitizerEnter() { sanitizerDepth++; }
+extern "C" void RealtimeSanitizerLeave() { sanitizerDepth--; }
+
+static void *SanitizerFind(const char *name) {
+	// The definitions after ours, in the C library. The result is the same on every thread, so racing lookups are harmless.
+	void *function = dlsym(RTLD_NEXT, name);
+	if (!function) abort();
+	return function;
+}
+
+#define SANITIZER_REAL(name) static decltype(&name) real = nullptr; if (!real) real = (decltype(&name)) SanitizerFind(#name)
+
+// The condition variable functions have an older version for compatibility, which dlsym would find, so the current one is asked for by name.
+#define SANITIZER_REAL_VERSION(name, version) static decltype(&name) real = nullptr; \
+	if (!real && !(real = (decltype(&name)) dlvsym(RTLD_NEXT, #name, version))) abort()
+
+static void SanitizerCheck(const char *function, bool blocking = false) {
+	if (!sanitizerDepth || sanitizerReporting || (blocking && sanitizerAllowBlocking)) return;
+	sanitizerReporting = true;
+	uint32_t index = sanitizerViolations.fetch_add(1, std::memory_order_relaxed);
+	if (!sanitizerFirstReported) sanitizerFirstReported = function;
+
+	if (index < SANITIZER_MAXIMUM_REPORTS) {
+		void *frames[SANITIZER_MAXIMUM_FRAMES];
+		int frameCount = backtrace(frames, SANITIZER_MAXIMUM_FRAMES);
+		fprintf(stderr, "Realtime sanitizer: %s called on a realtime thread.\n", function);
+		backtrace_symbols_fd(frames + 1, frameCount - 1, 2 /* stderr */);
+	}
+
+	sanitizerReporting = false;
+}
+
+static void SanitizerInitialise() {
+	// backtrace loads libgcc on its first call, which allocates, so it is done before any thread is marked.
+	void *frame;
+	backtrace(&frame, 1);
+}
+
+static uint32_t SanitizerFinish() {
+	uint32_t violations = sanitizerViolations.load(std::memory_order_relaxed);
+	fflush(stdout);
+	fprintf(stderr, "Realtime sanitizer: %u violation%s.\n", violations, violations == 1 ? "" : "s");
+	return violations;
+}
+
+extern "C" void *malloc(size_t size) noexcept { SanitizerCheck("malloc"); return __libc_malloc(size); }
+extern "C" void *calloc(size_t count, size_t size) noexcept { SanitizerCheck("calloc"); return __libc_calloc(count, size); }
+extern "C" void *realloc(void *pointer, size_t size) noexcept { SanitizerCheck("realloc"); return __libc_realloc(pointer, size); }
+extern "C" void free(void *pointer) noexcept { if (pointer) SanitizerCheck("free"); __libc_free(pointer); }
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+	SANITIZER_REAL(pthread_mutex_lock);
+	SanitizerCheck("pthread_mutex_lock");
+	return real(mutex);
+}
+
+extern "C" FILE *fopen(const char *path, const char *mode) {
+	SANITIZER_REAL(fopen);
+	SanitizerCheck("fopen");
+	return real(path, mode);
+}
+
+extern "C" int fclose(FILE *file) {
+	SANITIZER_REAL(fclose);
+	SanitizerCheck("fclose");
+	return real(file);
+}
+
+extern "C" size_t fread(void *buffer, size_t size, size_t count, FILE *file) {
+	SANITIZER_REAL(fread);
+	SanitizerCheck("fread");
+	return real(buffer, size, count, file);
+}
+
+extern "C" size_t fwrite(const void *buffer, size_t size, size_t count, FILE *file) {
+	SANITIZER_REAL(fwrite);
+	SanitizerCheck("fwrite");
+	return real(buffer, size, count, file);
+}
+
+extern "C" int fflush(FILE *file) {
+	SANITIZER_REAL(fflush);
+	SanitizerCheck("fflush");
+	return real(file);
+}
+
+extern "C" int fprintf(FILE *file, const char *format, ...) {
+	SanitizerCheck("fprintf");
+	va_list arguments;
+	va_start(arguments, format);
+	int result = vfprintf(file, format, arguments);
+	va_end(arguments);
+	return result;
+}
+
+extern "C" int printf(const char *format, ...) {
+	SanitizerCheck("printf");
+	va_list arguments;
+	va_start(arguments, format);
+	int result = vprintf(format, arguments);
+	va_end(arguments);
+	return result;
+}
+
+extern "C" int open(const char *path, int flags, ...) {
+	SANITIZER_REAL(open);
+	SanitizerCheck("open");
+	mode_t mode = 0;
+
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+		// The mode is only passed when a file can be created.
+		va_list arguments;
+		va_start(arguments, flags);
+		mode = va_arg(arguments, mode_t);
+		va_end(arguments);
+	}
+
+	return real(path, flags, mode);
+}
+
+extern "C" ssize_t read(int file, void *buffer, size_t count) {
+	SANITIZER_REAL(read);
+	SanitizerCheck("read");
+	return real(file, buffer, count);
+}
+
+extern "C" ssize_t write(int file, const void *buffer, size_t count) {
+	SANITIZER_REAL(write);
+	SanitizerCheck("write");
+	return real(file, buffer, count);
+}
+
+extern "C" int sem_wait(sem_t *semaphore) {
+	SANITIZER_REAL(sem_wait);
+	SanitizerCheck("sem_wait", true);
+	return real(semaphore);
+}
+
+extern "C" int sem_timedwait(sem_t *semaphore, const struct timespec *deadline) {
+	SANITIZER_REAL(sem_timedwait);
+	SanitizerCheck("sem_timedwait", true);
+	return real(semaphore, deadline);
+}
+
+extern "C" int pthread_cond_wait(pthread_cond_t *condition, pthread_mutex_t *mutex) {
+	SANITIZER_REAL_VERSION(pthread_cond_wait, "GLIBC_2.3.2");
+	SanitizerCheck("pthread_cond_wait", true);
+	return real(condition, mutex);
+}
+
+extern "C" int pthread_cond_timedwait(pthread_cond_t *condition, pthread_mutex_t *mutex, const struct timespec *deadline) {
+	SANITIZER_REAL_VERSION(pthread_cond_timedwait, "GLIBC_2.3.2");
+	SanitizerCheck("pthread_cond_timedwait", true);
+	return real(condition, mutex, deadline);
+}
+
+extern "C" int pthread_join(pthread_t thread, void **result) {
+	SANITIZER_REAL(pthread_join);
+	SanitizerCheck("pthread_join", true);
+	return real(thread, result);
+}
+
+static bool SanitizerTestCall(const char *name, void (*call)()) {
+	// The call may make others that are reported too, such as fopen allocating its buffer, so only the first report is checked.
+	sanitizerFirstReported = nullptr;
+	RealtimeSanitizerEnter();
+	call();
+	RealtimeSanitizerLeave();
+	bool reported = sanitizerFirstReported && 0 == strcmp(sanitizerFirstReported, name);
+	printf("%-28s%s\n", name, reported ? "reported" : "MISSED");
+	return reported;
+}
+
+static int SanitizerTest() {
+	// Makes one call of each kind on a thread marked realtime, and checks that it is reported.
+	// None of the calls block: the semaphore is posted first, the timed wait's deadline has passed, and the joined thread has finished.
+	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+	static pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
+	static sem_t semaphore;
+	static pthread_t thread;
+	static void *allocation;
+	static FILE *file;
+	static int descriptor;
+	sem_init(&semaphore, 0, 0);
+	sem_post(&semaphore);
+	pthread_create(&thread, nullptr, [] (void *) -> void * { return nullptr; }, nullptr);
+	uint32_t missed = 0;
+
+	missed += !SanitizerTestCall("malloc", [] () { allocation = malloc(16); });
+	free(allocation);
+	missed += !SanitizerTestCall("pthread_mutex_lock", [] () { pthread_mutex_lock(&mutex); });
+	pthread_mutex_unlock(&mutex);
+	missed += !SanitizerTestCall("fopen", [] () { file = fopen("/dev/null", "rb"); });
+	if (file) fclose(file);
+	missed += !SanitizerTestCall("open", [] () { descriptor = open("/dev/null", O_RDONLY); });
+	if (descriptor >= 0) close(descriptor);
+	missed += !SanitizerTestCall("sem_wait", [] () { sem_wait(&semaphore); });
+	pthread_mutex_lock(&mutex);
+	missed += !SanitizerTestCall("pthread_cond_timedwait", [] () {
+		struct timespec deadline = {};
+		pthread_cond_timedwait(&condition, &mutex, &deadline);
+	});
+	pthread_mutex_unlock(&mutex);
+	missed += !SanitizerTestCall("pthread_join", [] () { pthread_join(thread, nullptr); });
+
+	sem_destroy(&semaphore);
+	printf("%u missed.\n", missed);
+	return missed ? 1 : 0;
+}
+#endif
+
+static double HostTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void ScriptAdd(Script *script, ScriptEvent event) {
+	if (script->count == script->capacity) {
+		script->capacity = script->capacity ? script->capacity * 2 : 256;
+		script->events = (ScriptEvent *) realloc(script->events, script->capacity * sizeof(ScriptEvent));
+	}
+
+	event.order = script->count;
+	script->events[script->count++] = event;
+	if (event.time > script->length) script->length = event.time;
+}
+
+static int ScriptCompareEvents(const void *_a, const void *_b) {
+	// Events at the same time keep their order, so a note off before a note on of the same key is respected.
+	const ScriptEvent *a = (const ScriptEvent *) _a, *b = (const ScriptEvent *) _b;
+	return a->time < b->time ? -1 : a->time > b->time ? 1 : a->order < b->order ? -1 : a->order > b->order;
+}
+
+static clap_id HostFindParameter(const clap_plugin_t *plugin, const char *_name) {
+	// Underscores stand for spaces in parameter names, in scripts and in --set, so that they do not need quoting.
+	const clap_plugin_params_t *params = (const clap_plugin_params_t *) plugin->get_extension(plugin, CLAP_EXT_PARAMS);
+	if (!params) return CLAP_INVALID_ID;
+	char name[CLAP_NAME_SIZE];
+	snprintf(name, sizeof(name), "%s", _name);
+	for (char *c = name; *c; c++) if (*c == '_') *c = ' ';
+
+	for (uint32_t i = 0; i < params->count(plugin); i++) {
+		clap_param_info_t information = {};
+		if (params->get_info(plugin, i, &information) && 0 == strcmp(information.name, name)) return information.id;
+	}
+
+	return CLAP_INVALID_ID;
+}
+
+static bool ScriptLoad(Script *script, const clap_plugin_t *plugin, const char *path) {
+	// Each line is a time in seconds followed by an event, and # starts a comment:
+	//     0.0 on 60 1.0          note on, with key and velocity
+	//     2.0 off 60             note off
+	//     0.5 param Volume 0.3   parameter value, by name
+	FILE *file = fopen(path, "rb");
+	if (!file) return false;
+	char line[256];
+	uint32_t lineNumber = 0;
+
+	while (fgets(line, sizeof(line), file)) {
+		lineNumber++;
+		char *comment = strchr(line, '#');
+		if (comment) *comment = 0;
+		ScriptEvent event = {};
+		char type[16], name[128];
+		int key;
+		int fieldCount = sscanf(line, "%lf %15s", &event.time, type);
+		if (fieldCount == EOF) continue;
+
+		if (fieldCount == 2 && 0 == strcmp(type, "on") && sscanf(line, "%*f %*s %d %lf", &key, &event.value) == 2) {
+			event.type = SCRIPT_NOTE_ON, event.key = key;
+		} else if (fieldCount == 2 && 0 == strcmp(type, "off") && sscanf(line, "%*f %*s %d", &key) == 1) {
+			event.type = SCRIPT_NOTE_OFF, event.key = key;
+		} else if (fieldCount == 2 && 0 == strcmp(type, "param") && sscanf(line, "%*f %*s %127s %lf", name, &event.value) == 2) {
+			event.type = SCRIPT_PARAMETER, event.parameter = HostFindParameter(plugin, name);
+
+			if (event.parameter == CLAP_INVALID_ID) {
+				fprintf(stderr, "%s:%u: unknown parameter '%s'\n", path, lineNumber, name);
+				continue;
+			}
+		} else {
+			fprintf(stderr, "%s:%u: could not parse event\n", path, lineNumber);
+			continue;
+		}
+
+		ScriptAdd(script, event);
+	}
+
+	fclose(file);
+	return true;
+}
+
+static void ScriptGenerate(Script *script, const clap_plugin_t *plugin, const HostOptions *options) {
+	// Starts notesPerBeat notes every half second, spread over the keyboard, each held for holdTime,
+	// while the filter cutoff and volume are automated every 10 ms.
+	static const int16_t chordOffsets[] = { 0, 4, 7, 11, 14, 17, 21, 24 };
+	clap_id cutoff = HostFindParameter(plugin, "Filter Cutoff"), volume = HostFindParameter(plugin, "Volume");
+	uint32_t beat = 0;
+
+	for (double time = 0.0; time < options->seconds; time += 0.5, beat++) {
+		int16_t root = 36 + (beat * 5) % 24;
+
+		for (uint32_t i = 0; i < options->notesPerBeat; i++) {
+			int16_t key = root + chordOffsets[i % 8] + 12 * (i / 8);
+			if (key > 127) key = 127;
+			double end = time + options->holdTime < options->seconds ? time + options->holdTime : options->seconds;
+			ScriptAdd(script, { .time = time, .type = SCRIPT_NOTE_ON, .key = key, .value = 0.8 });
+			ScriptAdd(script, { .time = end, .type = SCRIPT_NOTE_OFF, .key = key });
+		}
+	}
+
+	for (double time = 0.0; time < options->seconds; time += 0.01) {
+		if (cutoff != CLAP_INVALID_ID) ScriptAdd(script, { .time = time, .type = SCRIPT_PARAMETER, .parameter = cutoff, .value = 0.6 + 0.3 * sin(time) });
+		if (volume != CLAP_INVALID_ID) ScriptAdd(script, { .time = time, .type = SCRIPT_PARAMETER, .parameter = volume, .value = 0.4 + 0.1 * sin(time * 3.0) });
+	}
+
+	script->length = options->seconds;
+}
+
+static uint32_t HostInputSize(const clap_input_events_t *list) {
+	return ((HostBlockEvents *) list->ctx)->count;
+}
+
+static const clap_event_header_t *HostInputGet(const clap_input_events_t *list, uint32_t index) {
+	return &((HostBlockEvents *) list->ctx)->events[index].header;
+}
+
+static bool HostOutputTryPush(const clap_output_events_t *list, const clap_event_header_t *event) {
+	if (event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_NOTE_END) {
+		((HostBlockEvents *) list->ctx)->voicesEnded++;
+	}
+
+	return true;
+}
+
+static int HostCompareTimes(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+static void HostRun(const clap_plugin_entry_t *entry, const HostOptions *options, uint32_t blockSize, uint32_t sampleRate) {
+	const clap_plugin_factory_t *factory = (const clap_plugin_factory_t *) entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+	const clap_plugin_t *plugin = factory->create_plugin(factory, &host, factory->get_plugin_descriptor(factory, 0)->id);
+
+	if (!plugin || !plugin->init(plugin)) {
+		fprintf(stderr, "Could not create the plugin.\n");
+		exit(1);
+	}
+
+	Script script = {};
+
+	if (options->scriptPath) {
+		if (!ScriptLoad(&script, plugin, options->scriptPath)) {
+			fprintf(stderr, "Could not open the script '%s'.\n", options->scriptPath);
+			exit(1);
+		}
+
+		qsort(script.events, script.count, sizeof(ScriptEvent), ScriptCompareEvents);
+	} else {
+		ScriptGenerate(&script, plugin, options);
+		qsort(script.events, script.count, sizeof(ScriptEvent), ScriptCompareEvents);
+	}
+
+	// The settings are sent before the first note, as parameter events at the start of the script.
+	HostBlockEvents *blockEvents = (HostBlockEvents *) calloc(1, sizeof(HostBlockEvents));
+
+	for (uint32_t i = 0; i < options->settingCount; i++) {
+		clap_id id = HostFindParameter(plugin, options->settings[i].name);
+		if (id == CLAP_INVALID_ID) fprintf(stderr, "Unknown parameter '%s'.\n", options->settings[i].name);
+		if (id == CLAP_INVALID_ID || blockEvents->count == HOST_MAXIMUM_BLOCK_EVENTS) continue;
+		clap_event_param_value_t *event = &blockEvents->events[blockEvents->count++].parameter;
+		*event = {};
+		event->header = { .size = sizeof(*event), .time = 0, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = CLAP_EVENT_PARAM_VALUE };
+		event->param_id = id, event->note_id = -1, event->port_index = -1, event->channel = -1, event->key = -1;
+		event->value = options->settings[i].value;
+	}
+
+	const clap_plugin_render_t *render = (const clap_plugin_render_t *) plugin->get_extension(plugin, CLAP_EXT_RENDER);
+	if (render) render->set(plugin, options->offline ? CLAP_RENDER_OFFLINE : CLAP_RENDER_REALTIME);
+	plugin->activate(plugin, sampleRate, 1, blockSize);
+	plugin->start_processing(plugin);
+
+	float *outputL = (float *) calloc(blockSize, sizeof(float)), *outputR = (float *) calloc(blockSize, sizeof(float));
+	float *data[2] = { outputL, outputR };
+	clap_audio_buffer_t output = {};
+	output.data32 = data;
+	output.channel_count = 2;
+
+	clap_input_events_t in = { .ctx = blockEvents, .size = HostInputSize, .get = HostInputGet };
+	clap_output_events_t out = { .ctx = blockEvents, .try_push = HostOutputTryPush };
+	clap_process_t process = {};
+	process.steady_time = 0;
+	process.frames_count = blockSize;
+	process.audio_outputs = &output;
+	process.audio_outputs_count = 1;
+	process.in_events = &in;
+	process.out_events = &out;
+
+	uint64_t frameCount = (uint64_t) ceil(script.length * sampleRate) + sampleRate; // A second extra for the release tails.
+	uint32_t blockCount = (uint32_t) ((frameCount + blockSize - 1) / blockSize);
+	double *blockTimes = (double *) malloc(blockCount * sizeof(double));
+	uint32_t nextEvent = 0, voicesStarted = 0, maximumVoices = 0, eventsDropped = 0;
+	double totalTime = 0.0;
+
+	for (uint32_t block = 0; block < blockCount; block++) {
+		uint64_t blockEnd = (uint64_t) (block + 1) * blockSize;
+
+		while (nextEvent < script.count && (uint64_t) (script.events[nextEvent].time * sampleRate) < blockEnd) {
+			const ScriptEvent *scriptEvent = &script.events[nextEvent++];
+			uint32_t time = (uint32_t) ((uint64_t) (scriptEvent->time * sampleRate) - (uint64_t) block * blockSize);
+
+			if (blockEvents->count == HOST_MAXIMUM_BLOCK_EVENTS) {
+				eventsDropped++;
+			} else if (scriptEvent->type == SCRIPT_PARAMETER) {
+				clap_event_param_value_t *event = &blockEvents->events[blockEvents->count++].parameter;
+				*event = {};
+				event->header = { .size = sizeof(*event), .time = time, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = CLAP_EVENT_PARAM_VALUE };
+				event->param_id = scriptEvent->parameter, event->note_id = -1, event->port_index = -1, event->channel = -1, event->key = -1;
+				event->value = scriptEvent->value;
+			} else if (options->dialect == CLAP_NOTE_DIALECT_MIDI) {
+				clap_event_midi_t *event = &blockEvents->events[blockEvents->count++].midi;
+				*event = {};
+				event->header = { .size = sizeof(*event), .time = time, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = CLAP_EVENT_MIDI };
+				event->data[0] = scriptEvent->type == SCRIPT_NOTE_ON ? 0x90 : 0x80;
+				event->data[1] = scriptEvent->key & 0x7F;
+				event->data[2] = (uint8_t) (scriptEvent->value * 127.0 + 0.5);
+				if (scriptEvent->type == SCRIPT_NOTE_ON) voicesStarted++;
+			} else if (options->dialect == CLAP_NOTE_DIALECT_MIDI2) {
+				// A MIDI 2.0 channel voice message in a universal MIDI packet, with a 16-bit velocity.
+				clap_event_midi2_t *event = &blockEvents->events[blockEvents->count++].midi2;
+				*event = {};
+				event->header = { .size = sizeof(*event), .time = time, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = CLAP_EVENT_MIDI2 };
+				event->data[0] = 0x40000000 | (scriptEvent->type == SCRIPT_NOTE_ON ? 0x900000 : 0x800000) | (scriptEvent->key & 0x7F) << 8;
+				event->data[1] = (uint32_t) (scriptEvent->value * 65535.0 + 0.5) << 16;
+				if (scriptEvent->type == SCRIPT_NOTE_ON) voicesStarted++;
+			} else {
+				clap_event_note_t *event = &blockEvents->events[blockEvents->count++].note;
+				uint16_t type = scriptEvent->type == SCRIPT_NOTE_ON ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF;
+				*event = {};
+				event->header = { .size = sizeof(*event), .time = time, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = type };
+				event->note_id = -1, event->port_index = 0, event->channel = 0, event->key = scriptEvent->key;
+				event->velocity = scriptEvent->value;
+				if (type == CLAP_EVENT_NOTE_ON) voicesStarted++;
+			}
+		}
+
+		double start = HostTime();
+		plugin->process(plugin, &process);
+		double elapsed = HostTime() - start;
+
+		blockTimes[block] = elapsed;
+		totalTime += elapsed;
+		process.steady_time += blockSize;
+		blockEvents->count = 0;
+
+		// Every voice sends a NOTE_END when it finishes or is stolen, so the difference is the number playing after the block.
+		uint32_t voices = voicesStarted - blockEvents->voicesEnded;
+		if (voices > maximumVoices) maximumVoices = voices;
+	}
+
+	qsort(blockTimes, blockCount, sizeof(double), HostCompareTimes);
+	double budget = (double) blockSize / sampleRate;
+	double percentiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+	printf("%-8u%-10u%-12.1f", blockSize, sampleRate, (double) blockCount * blockSize / sampleRate / totalTime);
+
+	for (uint32_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+		double time = blockTimes[(uint32_t) (percentiles[i] * (blockCount - 1))];
+		printf("%8.1f (%3.0f%%)", time * 1e6, time / budget * 100.0);
+	}
+
+	printf("%8u\n", maximumVoices);
+	if (eventsDropped) fprintf(stderr, "%u events were dropped, since more than %d fell in one block.\n", eventsDropped, HOST_MAXIMUM_BLOCK_EVENTS);
+
+	plugin->stop_processing(plugin);
+	plugin->deactivate(plugin);
+	plugin->destroy(plugin);
+	free(blockTimes);
+	free(outputL);
+	free(outputR);
+	free(blockEvents);
+	free(script.events);
+}
+
+static uint32_t HostParseList(const char *text, uint32_t *values) {
+	uint32_t count = 0;
+
+	while (*text && count < HOST_MAXIMUM_RUNS) {
+		char *end;
+		values[count++] = (uint32_t) strtoul(text, &end, 10);
+		text = *end == ',' ? end + 1 : end;
+		if (end == text && *end) break;
+	}
+
+	return count;
+}
+
+static void HostPrintUsage(const char *program) {
+	fprintf(stderr, "Usage: %s PLUGIN [options]\n"
+			"    --block-sizes 64,256,1024    Block sizes to run, in frames.\n"
+			"    --sample-rates 44100,48000   Sample rates to run, in Hz.\n"
+			"    --script FILE                Play the events in FILE instead of the generated script.\n"
+			"    --seconds 30                 Length of the generated script.\n"
+			"    --notes 8                    Notes the generated script starts every half second.\n"
+			"    --hold 2                     Seconds each note of the generated script is held.\n"
+			"    --set NAME=VALUE             Set a parameter, by name with _ for spaces, before the script starts. Can be repeated.\n"
+			"    --offline                    Ask the plugin to render offline.\n"
+			"    --dialect clap               Send the notes as clap events, midi or midi2 messages.\n", program);
+#ifdef RT_SANITIZER
+	fprintf(stderr, "Or: %s --sanitizer-test, to check that the realtime sanitizer reports each kind of call.\n", program);
+#endif
+}
+
+int main(int argc, char **argv) {
+#ifdef RT_SANITIZER
+	SanitizerInitialise();
+#endif
+
+	HostOptions options = {};
+	options.blockSizes[0] = 64, options.blockSizes[1] = 256, options.blockSizes[2] = 1024, options.blockSizeCount = 3;
+	options.sampleRates[0] = 48000, options.sampleRateCount = 1;
+	options.seconds = 30.0;
+	options.notesPerBeat = 8;
+	options.holdTime = 2.0;
+	options.dialect = CLAP_NOTE_DIALECT_CLAP;
+
+#ifdef RT_SANITIZER
+	if (argc == 2 && 0 == strcmp(argv[1], "--sanitizer-test")) {
+		return SanitizerTest();
+	}
+#endif
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+
+		if (0 == strcmp(argv[i], "--block-sizes") && hasValue) {
+			options.blockSizeCount = HostParseList(argv[++i], options.blockSizes);
+		} else if (0 == strcmp(argv[i], "--sample-rates") && hasValue) {
+			options.sampleRateCount = HostParseList(argv[++i], options.sampleRates);
+		} else if (0 == strcmp(argv[i], "--script") && hasValue) {
+			options.scriptPath = argv[++i];
+		} else if (0 == strcmp(argv[i], "--seconds") && hasValue) {
+			options.seconds = atof(argv[++i]);
+		} else if (0 == strcmp(argv[i], "--notes") && hasValue) {
+			options.notesPerBeat = (uint32_t) atoi(argv[++i]);
+		} else if (0 == strcmp(argv[i], "--hold") && hasValue) {
+			options.holdTime = atof(argv[++i]);
+		} else if (0 == strcmp(argv[i], "--set") && hasValue && strchr(argv[i + 1], '=') && options.settingCount < HOST_MAXIMUM_SETTINGS) {
+			char *setting = argv[++i], *equals = strchr(setting, '=');
+			*equals = 0;
+			options.settings[options.settingCount++] = { .name = setting, .value = atof(equals + 1) };
+		} else if (0 == strcmp(argv[i], "--offline")) {
+			options.offline = true;
+		} else if (0 == strcmp(argv[i], "--dialect") && hasValue) {
+			const char *dialect = argv[++i];
+			options.dialect = 0 == strcmp(dialect, "midi") ? CLAP_NOTE_DIALECT_MIDI : 0 == strcmp(dialect, "midi2") ? CLAP_NOTE_DIALECT_MIDI2 
+				: 0 == strcmp(dialect, "clap") ? CLAP_NOTE_DIALECT_CLAP : 0;
+		} else if (argv[i][0] != '-' && !options.pluginPath) {
+			options.pluginPath = argv[i];
+		} else {
+			HostPrintUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!options.pluginPath || !options.blockSizeCount || !options.sampleRateCount || !options.dialect) {
+		HostPrintUsage(argv[0]);
+		return 1;
+	}
+
+#ifdef RT_SANITIZER
+	sanitizerAllowBlocking = options.offline;
+#endif
+
+	// A path without a slash would be looked up in the library search path.
+	char path[4096];
+	snprintf(path, sizeof(path), "%s%s", strchr(options.pluginPath, '/') ? "" : "./", options.pluginPath);
+	void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+	if (!library) {
+		fprintf(stderr, "Could not load the plugin: %s\n", dlerror());
+		return 1;
+	}
+
+	const clap_plugin_entry_t *entry = (const clap_plugin_entry_t *) dlsym(library, "clap_entry");
+
+	if (!entry || !entry->init(path)) {
+		fprintf(stderr, "The plugin has no usable clap_entry.\n");
+		return 1;
+	}
+
+	printf("%-8s%-10s%-12s%15s%15s%15s%15s%15s%8s\n", "block", "rate", "realtime", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "voices");
+
+	for (uint32_t i = 0; i < options.sampleRateCount; i++) {
+		for (uint32_t j = 0; j < options.blockSizeCount; j++) {
+			HostRun(entry, &options, options.blockSizes[j], options.sampleRates[i]);
+		}
+	}
+
+	entry->deinit();
+	dlclose(library);
+
+#ifdef RT_SANITIZER
+	if (SanitizerFinish()) return 2;
+#endif
+
+	return 0;
+}
@@ -3,164 +3,2936 @@
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
+#include <atomic>
 #include "clap/clap.h"
 
-template <class T>
-struct Array {
-	T *array;
-	size_t length, allocated;
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE Mutex;
+#define MutexAcquire(mutex) WaitForSingleObject(mutex, INFINITE)
+#define MutexRelease(mutex) ReleaseMutex(mutex)
+#define MutexInitialise(mutex) (mutex = CreateMutex(nullptr, FALSE, nullptr))
+#define MutexDestroy(mutex) CloseHandle(mutex)
+typedef HANDLE Semaphore;
+#define SemaphoreInitialise(semaphore) (semaphore = CreateSemaphore(nullptr, 0, 0x7FFFFFFF, nullptr))
+#define SemaphorePost(semaphore) ReleaseSemaphore(semaphore, 1, nullptr)
+#define SemaphoreWait(semaphore) WaitForSingleObject(semaphore, INFINITE)
+#define SemaphoreDestroy(semaphore) CloseHandle(semaphore)
+typedef HANDLE Thread;
+#define ThreadStart(thread, function, argument) (thread = CreateThread(nullptr, 0, (LPTHREAD_START_ROUTINE) (function), argument, 0, nullptr))
+#define ThreadJoin(thread) (WaitForSingleObject(thread, INFINITE), CloseHandle(thread))
+#define ProcessorCount() GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)
+static inline uint64_t TimeGetNanoseconds() {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t) (counter.QuadPart * (1e9 / frequency.QuadPart));
+}
+#else
+#include <pthread.h>
+typedef pthread_mutex_t Mutex;
+#define MutexAcquire(mutex) pthread_mutex_lock(&(mutex))
+#define MutexRelease(mutex) pthread_mutex_unlock(&(mutex))
+#define MutexInitialise(mutex) pthread_mutex_init(&(mutex), nullptr)
+#define MutexDestroy(mutex) pthread_mutex_destroy(&(mutex))
+typedef pthread_t Thread;
+#define ThreadStart(thread, function, argument) pthread_create(&(thread), nullptr, function, argument)
+#define ThreadJoin(thread) pthread_join(thread, nullptr)
+#include <unistd.h>
+#define ProcessorCount() sysconf(_SC_NPROCESSORS_ONLN)
+#include <time.h>
+static inline uint64_t TimeGetNanoseconds() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+#ifdef __APPLE__
+#include <dispatch/dispatch.h>
+typedef dispatch_semaphore_t Semaphore;
+#define SemaphoreInitialise(semaphore) (semaphore = dispatch_semaphore_create(0))
+#define SemaphorePost(semaphore) dispatch_semaphore_signal(semaphore)
+#define SemaphoreWait(semaphore) dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER)
+#define SemaphoreDestroy(semaphore) dispatch_release(semaphore)
+#else
+#include <semaphore.h>
+typedef sem_t Semaphore;
+#define SemaphoreInitialise(semaphore) sem_init(&(semaphore), 0, 0)
+#define SemaphorePost(semaphore) sem_post(&(semaphore))
+#define SemaphoreWait(semaphore) while (sem_wait(&(semaphore)) == -1)
+#define SemaphoreDestroy(semaphore) sem_destroy(&(semaphore))
+#endif
+#endif
+
+// Realtime sanitizer.
+// Build with -DRT_SANITIZER to mark the threads running process, flush and render tasks as realtime.
+// A host built with the sanitizer (see clap-tutorial-host.cpp) then reports any allocation, lock or file operation they make.
+// Other hosts don't define the hooks, so the weak references are null and the marks do nothing.
+
+#if defined(RT_SANITIZER) && !defined(_WIN32)
+extern "C" __attribute__((weak)) void RealtimeSanitizerEnter();
+extern "C" __attribute__((weak)) void RealtimeSanitizerLeave();
+#define RealtimeEnter() (RealtimeSanitizerEnter ? RealtimeSanitizerEnter() : (void) 0)
+#define RealtimeLeave() (RealtimeSanitizerLeave ? RealtimeSanitizerLeave() : (void) 0)
+#else
+#define RealtimeEnter()
+#define RealtimeLeave()
+#endif
+
+// SIMD.
+// Voices are rendered in groups of VOICE_GROUP_SIZE, one voice per lane.
+// Build with -mavx2 -mfma (8 lanes) or -mavx512f (16 lanes) to enable the vector paths.
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define SIMD_WIDTH (16)
+#define VOICE_GROUP_VECTORS (2)
+typedef __m512 SIMDFloat;
+typedef __mmask16 SIMDMask;
+static inline SIMDFloat SIMDLoad(const float *p) { return _mm512_loadu_ps(p); }
+static inline void SIMDStore(float *p, SIMDFloat a) { _mm512_storeu_ps(p, a); }
+static inline SIMDFloat SIMDBroadcast(float x) { return _mm512_set1_ps(x); }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b) { return _mm512_add_ps(a, b); }
+static inline SIMDFloat SIMDSub(SIMDFloat a, SIMDFloat b) { return _mm512_sub_ps(a, b); }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b) { return _mm512_mul_ps(a, b); }
+static inline SIMDFloat SIMDDiv(SIMDFloat a, SIMDFloat b) { return _mm512_div_ps(a, b); }
+static inline SIMDFloat SIMDMulAdd(SIMDFloat a, SIMDFloat b, SIMDFloat c) { return _mm512_fmadd_ps(a, b, c); }
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b) { return _mm512_min_ps(a, b); }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b) { return _mm512_max_ps(a, b); }
+static inline SIMDFloat SIMDFloor(SIMDFloat a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+static inline SIMDMask SIMDGreaterThan(SIMDFloat a, SIMDFloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+static inline SIMDMask SIMDLessThan(SIMDFloat a, SIMDFloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+static inline SIMDFloat SIMDSelect(SIMDMask mask, SIMDFloat a, SIMDFloat b) { return _mm512_mask_blend_ps(mask, b, a); }
+static inline float SIMDSum(SIMDFloat a) { return _mm512_reduce_add_ps(a); }
+typedef __m512i SIMDInt;
+static inline SIMDInt SIMDTruncate(SIMDFloat a) { return _mm512_cvttps_epi32(a); }
+static inline SIMDFloat SIMDIntToFloat(SIMDInt a) { return _mm512_cvtepi32_ps(a); }
+static inline SIMDInt SIMDIntAdd(SIMDInt a, SIMDInt b) { return _mm512_add_epi32(a, b); }
+static inline SIMDInt SIMDIntSub(SIMDInt a, SIMDInt b) { return _mm512_sub_epi32(a, b); }
+static inline SIMDInt SIMDIntAnd(SIMDInt a, SIMDInt b) { return _mm512_and_si512(a, b); }
+static inline SIMDInt SIMDIntBroadcast(int32_t x) { return _mm512_set1_epi32(x); }
+static inline SIMDFloat SIMDGather(const float *base, SIMDInt index) { return _mm512_i32gather_ps(index, base, 4); }
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH (8)
+#define VOICE_GROUP_VECTORS (2)
+typedef __m256 SIMDFloat;
+typedef __m256 SIMDMask;
+static inline SIMDFloat SIMDLoad(const float *p) { return _mm256_loadu_ps(p); }
+static inline void SIMDStore(float *p, SIMDFloat a) { _mm256_storeu_ps(p, a); }
+static inline SIMDFloat SIMDBroadcast(float x) { return _mm256_set1_ps(x); }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b) { return _mm256_add_ps(a, b); }
+static inline SIMDFloat SIMDSub(SIMDFloat a, SIMDFloat b) { return _mm256_sub_ps(a, b); }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b) { return _mm256_mul_ps(a, b); }
+static inline SIMDFloat SIMDDiv(SIMDFloat a, SIMDFloat b) { return _mm256_div_ps(a, b); }
+#ifdef __FMA__
+static inline SIMDFloat SIMDMulAdd(SIMDFloat a, SIMDFloat b, SIMDFloat c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+static inline SIMDFloat SIMDMulAdd(SIMDFloat a, SIMDFloat b, SIMDFloat c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b) { return _mm256_min_ps(a, b); }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b) { return _mm256_max_ps(a, b); }
+static inline SIMDFloat SIMDFloor(SIMDFloat a) { return _mm256_floor_ps(a); }
+static inline SIMDMask SIMDGreaterThan(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline SIMDMask SIMDLessThan(SIMDFloat a, SIMDFloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline SIMDFloat SIMDSelect(SIMDMask mask, SIMDFloat a, SIMDFloat b) { return _mm256_blendv_ps(b, a, mask); }
+
+static inline float SIMDSum(SIMDFloat a) { 
+	__m128 x = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+	x = _mm_add_ss(x, _mm_movehdup_ps(x));
+	return _mm_cvtss_f32(x);
+}
+
+typedef __m256i SIMDInt;
+static inline SIMDInt SIMDTruncate(SIMDFloat a) { return _mm256_cvttps_epi32(a); }
+static inline SIMDFloat SIMDIntToFloat(SIMDInt a) { return _mm256_cvtepi32_ps(a); }
+static inline SIMDInt SIMDIntAdd(SIMDInt a, SIMDInt b) { return _mm256_add_epi32(a, b); }
+static inline SIMDInt SIMDIntSub(SIMDInt a, SIMDInt b) { return _mm256_sub_epi32(a, b); }
+static inline SIMDInt SIMDIntAnd(SIMDInt a, SIMDInt b) { return _mm256_and_si256(a, b); }
+static inline SIMDInt SIMDIntBroadcast(int32_t x) { return _mm256_set1_epi32(x); }
+static inline SIMDFloat SIMDGather(const float *base, SIMDInt index) { return _mm256_i32gather_ps(base, index, 4); }
+#else
+#define SIMD_WIDTH (1)
+#define VOICE_GROUP_VECTORS (4)
+typedef float SIMDFloat;
+typedef bool SIMDMask;
+static inline SIMDFloat SIMDLoad(const float *p) { return *p; }
+static inline void SIMDStore(float *p, SIMDFloat a) { *p = a; }
+static inline SIMDFloat SIMDBroadcast(float x) { return x; }
+static inline SIMDFloat SIMDAdd(SIMDFloat a, SIMDFloat b) { return a + b; }
+static inline SIMDFloat SIMDSub(SIMDFloat a, SIMDFloat b) { return a - b; }
+static inline SIMDFloat SIMDMul(SIMDFloat a, SIMDFloat b) { return a * b; }
+static inline SIMDFloat SIMDDiv(SIMDFloat a, SIMDFloat b) { return a / b; }
+static inline SIMDFloat SIMDMulAdd(SIMDFloat a, SIMDFloat b, SIMDFloat c) { return a * b + c; }
+static inline SIMDFloat SIMDMin(SIMDFloat a, SIMDFloat b) { return a < b ? a : b; }
+static inline SIMDFloat SIMDMax(SIMDFloat a, SIMDFloat b) { return a > b ? a : b; }
+static inline SIMDFloat SIMDFloor(SIMDFloat a) { return floorf(a); }
+static inline SIMDMask SIMDGreaterThan(SIMDFloat a, SIMDFloat b) { return a > b; }
+static inline SIMDMask SIMDLessThan(SIMDFloat a, SIMDFloat b) { return a < b; }
+static inline SIMDFloat SIMDSelect(SIMDMask mask, SIMDFloat a, SIMDFloat b) { return mask ? a : b; }
+static inline float SIMDSum(SIMDFloat a) { return a; }
+typedef int32_t SIMDInt;
+static inline SIMDInt SIMDTruncate(SIMDFloat a) { return (int32_t) a; }
+static inline SIMDFloat SIMDIntToFloat(SIMDInt a) { return (float) a; }
+static inline SIMDInt SIMDIntAdd(SIMDInt a, SIMDInt b) { return a + b; }
+static inline SIMDInt SIMDIntSub(SIMDInt a, SIMDInt b) { return a - b; }
+static inline SIMDInt SIMDIntAnd(SIMDInt a, SIMDInt b) { return a & b; }
+static inline SIMDInt SIMDIntBroadcast(int32_t x) { return x; }
+static inline SIMDFloat SIMDGather(const float *base, SIMDInt index) { return base[index]; }
+#endif
+
+#define VOICE_GROUP_SIZE (SIMD_WIDTH * VOICE_GROUP_VECTORS)
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline uint32_t CountTrailingZeros64(uint64_t x) { unsigned long index; _BitScanForward64(&index, x); return index; }
+#else
+static inline uint32_t CountTrailingZeros64(uint64_t x) { return __builtin_ctzll(x); }
+#endif
+
+// Parameters.
+#define P_VOLUME (0)
+#define P_VOICE_STEALING (1)
+#define P_ATTACK (2)
+#define P_DECAY (3)
+#define P_SUSTAIN (4)
+#define P_RELEASE (5)
+#define P_WAVEFORM (6)
+#define P_UNISON_VOICES (7)
+#define P_UNISON_DETUNE (8)
+#define P_UNISON_SPREAD (9)
+#define P_FILTER_MODE (10)
+#define P_FILTER_CUTOFF (11)
+#define P_FILTER_RESONANCE (12)
+#define P_FILTER_ENVELOPE (13)
+#define P_REVERB_MIX (14)
+#define P_REVERB_LENGTH (15)
+#define P_DELAY_MIX (16)
+#define P_DELAY_TIME (17)
+#define P_DELAY_FEEDBACK (18)
+#define P_DELAY_DEPTH (19)
+#define P_DELAY_RATE (20)
+#define P_LFO_RATE (21)
+#define P_LFO_VOLUME (22)
+#define P_LFO_CUTOFF (23)
+#define P_VELOCITY_VOLUME (24)
+#define P_VELOCITY_CUTOFF (25)
+#define P_BRIGHTNESS_CUTOFF (26)
+#define P_COUNT (27)
+
+// Parameter smoothing, so that automation ramps to its new value instead of stepping.
+#define PARAMETER_SMOOTHING_NONE (0)
+#define PARAMETER_SMOOTHING_LINEAR (1) // Reaches the target after PARAMETER_SMOOTHING_TIME.
+#define PARAMETER_SMOOTHING_ONE_POLE (2) // Exponential, with a time constant of a quarter of PARAMETER_SMOOTHING_TIME.
+#define PARAMETER_SMOOTHING_TIME (0.02f) // In seconds.
+#define PARAMETER_SMOOTHING_THRESHOLD (1e-5f) // A one-pole ramp snaps to its target once it is this close.
+
+static const uint8_t parameterSmoothing[P_COUNT] = {
+	PARAMETER_SMOOTHING_ONE_POLE, // P_VOLUME
+	PARAMETER_SMOOTHING_NONE, // P_VOICE_STEALING
+	PARAMETER_SMOOTHING_NONE, // P_ATTACK
+	PARAMETER_SMOOTHING_NONE, // P_DECAY
+	PARAMETER_SMOOTHING_NONE, // P_SUSTAIN
+	PARAMETER_SMOOTHING_NONE, // P_RELEASE
+	PARAMETER_SMOOTHING_NONE, // P_WAVEFORM
+	PARAMETER_SMOOTHING_NONE, // P_UNISON_VOICES
+	PARAMETER_SMOOTHING_NONE, // P_UNISON_DETUNE
+	PARAMETER_SMOOTHING_NONE, // P_UNISON_SPREAD
+	PARAMETER_SMOOTHING_NONE, // P_FILTER_MODE
+	PARAMETER_SMOOTHING_LINEAR, // P_FILTER_CUTOFF
+	PARAMETER_SMOOTHING_NONE, // P_FILTER_RESONANCE
+	PARAMETER_SMOOTHING_NONE, // P_FILTER_ENVELOPE
+	PARAMETER_SMOOTHING_LINEAR, // P_REVERB_MIX
+	PARAMETER_SMOOTHING_NONE, // P_REVERB_LENGTH
+	PARAMETER_SMOOTHING_LINEAR, // P_DELAY_MIX
+	PARAMETER_SMOOTHING_LINEAR, // P_DELAY_TIME
+	PARAMETER_SMOOTHING_LINEAR, // P_DELAY_FEEDBACK
+	PARAMETER_SMOOTHING_NONE, // P_DELAY_DEPTH
+	PARAMETER_SMOOTHING_NONE, // P_DELAY_RATE
+	PARAMETER_SMOOTHING_NONE, // P_LFO_RATE
+	PARAMETER_SMOOTHING_NONE, // P_LFO_VOLUME
+	PARAMETER_SMOOTHING_NONE, // P_LFO_CUTOFF
+	PARAMETER_SMOOTHING_NONE, // P_VELOCITY_VOLUME
+	PARAMETER_SMOOTHING_NONE, // P_VELOCITY_CUTOFF
+	PARAMETER_SMOOTHING_NONE, // P_BRIGHTNESS_CUTOFF
+};
+
+// Envelope stages. They are stored as floats, so that the envelopes of a voice group can be advanced with vector compares and selects.
+#define ENVELOPE_ATTACK (0)
+#define ENVELOPE_DECAY (1)
+#define ENVELOPE_SUSTAIN (2)
+#define ENVELOPE_RELEASE (3)
+#define ENVELOPE_FINISHED (4) // The voice can be reclaimed.
+#define ENVELOPE_CHUNK (16) // The envelopes are advanced once per chunk of this many frames, and interpolated linearly within it.
+#define ENVELOPE_THRESHOLD (1e-4f) // -80 dB. The decay and release times are how long it takes to get this close to their target.
+
+// Voice stealing policies, used when a note starts and the voice pool is full.
+#define VOICE_STEAL_OLDEST (0)
+#define VOICE_STEAL_QUIETEST (1)
+#define VOICE_STEAL_SAME_KEY (2) // Falls back to the oldest voice if no voice is playing the same key.
+#define VOICE_STEAL_COUNT (3)
+
+#ifndef VOICE_POOL_CAPACITY
+#define VOICE_POOL_CAPACITY (256)
+#endif
+
+// The voices are split into tasks of this many, which run on the host's thread pool if it has one.
+// Each task renders into its own scratch buffers, and they are mixed in task order, so the output does not depend on which threads ran them.
+#define RENDER_TASK_VOICES (32)
+#define RENDER_TASK_COUNT ((VOICE_POOL_CAPACITY + RENDER_TASK_VOICES - 1) / RENDER_TASK_VOICES)
+#define RENDER_TASK_MINIMUM_FRAMES (64) // Shorter sub-blocks are rendered on the audio thread, since dispatching them would cost more than it saves.
+// With a single processor the tasks cannot run in parallel, so they are never dispatched. Forcing them through a pool on a single-CPU
+// 2.1 GHz Xeon virtual machine (7 sub-oscillator saw, median of 5 runs) cost 19% of the render time at 64 voices, 9% at 128 and nothing at 256.
+static_assert(RENDER_TASK_VOICES % (SIMD_WIDTH * VOICE_GROUP_VECTORS) == 0, "Tasks must hold whole voice groups.");
+
+// Note events are applied at the start of the sub-block of this many frames that contains them, so dense events cannot make the voices render tiny blocks.
+// Values of smoothed parameters are unaffected, since their ramps start at the event's exact frame. Unsmoothed parameters are read for a whole sub-block,
+// so their values are applied like note events. A quantum of 1 is strict mode, applying every event at its exact frame, and splitting at every parameter value.
+#ifndef EVENT_QUANTUM
+#define EVENT_QUANTUM (16)
+#endif
+
+// Sine oscillator kernels. The kernel is chosen at build time, with SINE_KERNEL_DEFAULT.
+// Measured with clap-tutorial-benchmark.cpp (-O2 -mavx2 -mfma, 8 lanes, 64 voices), the median of 5 runs on a single-CPU 2.1 GHz Xeon virtual machine.
+// The error is against sin(2 pi phase) in double precision:
+//    kernel          max error   cycles/sample/voice
+//    POLYNOMIAL_5    6.8e-5      2.1
+//    POLYNOMIAL_9    1.7e-7      2.3
+//    TABLE           1.2e-6      2.5
+//    (libm sinf)     5.3e-6      26
+// This includes applying the smoothed volume and the envelope to each voice per sample.
+#define SINE_KERNEL_POLYNOMIAL_5 (0)
+#define SINE_KERNEL_POLYNOMIAL_9 (1)
+#define SINE_KERNEL_TABLE (2)
+#define SINE_KERNEL_COUNT (3)
+#define SINE_TABLE_SIZE (2048)
+
+#ifndef SINE_KERNEL_DEFAULT
+#define SINE_KERNEL_DEFAULT SINE_KERNEL_POLYNOMIAL_9
+#endif
+
+// Wavetable oscillators. Each waveform has a mip level per octave, band-limited so that it does not alias at the pitches that use it.
+// The tables are generated when the first instance is created, and shared read-only by all instances.
+#define WAVEFORM_SINE (0) // Rendered with the sine kernel rather than a table.
+#define WAVEFORM_SAW (1)
+#define WAVEFORM_SQUARE (2)
+#define WAVEFORM_TRIANGLE (3)
+#define WAVEFORM_COUNT (4)
+#define WAVETABLE_SIZE (SINE_TABLE_SIZE) // The tables are summed from sineTable.
+#define WAVETABLE_LEVELS (11) // Level i has the first (WAVETABLE_SIZE / 2) >> i harmonics, so the last level is a sine.
+#define WAVETABLE_STRIDE (WAVETABLE_SIZE + 4) // Each level has a guard sample for interpolating at phase 1, padded to keep levels aligned.
+#define OSCILLATOR_WAVETABLE (SINE_KERNEL_COUNT) // Follows the sine kernels in voiceGroupRenderers.
+
+// Unison. Each voice has UNISON_MAXIMUM detuned, stereo-spread sub-oscillators, of which the first P_UNISON_VOICES are used.
+// They are stored contiguously for each voice, so that each vector advances SIMD_WIDTH of them together.
+// Measured with clap-tutorial-benchmark.cpp (AVX2, 64 voices), in cycles per sample per voice, the median of 5 runs on the machine above:
+//    saw: 7 -> 23, 9 -> 41, 16 -> 33; sine: 7 -> 21, 9 -> 35, 16 -> 34. Individual runs varied by up to 25%.
+// 9 and 16 both take two vectors, so they cost about the same per voice, and 16 is the cheapest per sub-oscillator, at about 2 cycles against 3 to 5.
+#define UNISON_MAXIMUM (16)
+static_assert(UNISON_MAXIMUM % SIMD_WIDTH == 0, "A voice's sub-oscillators must fill whole vectors.");
+
+// The per-voice state-variable filter.
+// The cutoff parameter maps [0, 1] exponentially onto FILTER_MINIMUM_FREQUENCY * 2^(FILTER_OCTAVES x) Hz.
+// The filter's tan(pi f / sampleRate) coefficient is read from a table at the end of each envelope chunk, and interpolated linearly within it.
+// Voices are filtered in their SIMD lanes, so the cost per voice stays flat with polyphony. With clap-tutorial-benchmark.cpp (AVX2, saw),
+// the low-pass filter adds about 2.1 to 2.5 cycles per sample per voice at 16, 64 and 256 voices, the median of 5 runs on the machine above.
+#define FILTER_OFF (0)
+#define FILTER_LOW_PASS (1)
+#define FILTER_BAND_PASS (2)
+#define FILTER_HIGH_PASS (3)
+#define FILTER_MODE_COUNT (4)
+#define FILTER_MINIMUM_FREQUENCY (20.0f)
+#define FILTER_OCTAVES (10.0f)
+#define FILTER_TABLE_SIZE (256)
+
+// The per-voice modulation matrix. Each destination's offset is the host's modulation of it for the voice,
+// plus the sum of every source scaled by the amount in the parameter routing it there.
+// It is evaluated at the end of each envelope chunk, for a vector of voices at a time, and interpolated within the chunk.
+// The velocity source is the note's velocity minus 1, so that full velocity is unmodulated; the LFO is a sine in [-1, 1], restarted by each note.
+// The brightness source is the note's brightness expression, mapped to [-1, 1].
+// Sources and destinations can be added here, with an amount parameter for each route.
+#define MODULATION_SOURCE_ENVELOPE (0)
+#define MODULATION_SOURCE_LFO (1)
+#define MODULATION_SOURCE_VELOCITY (2)
+#define MODULATION_SOURCE_BRIGHTNESS (3)
+#define MODULATION_SOURCE_COUNT (4)
+#define MODULATION_DESTINATION_VOLUME (0)
+#define MODULATION_DESTINATION_CUTOFF (1)
+#define MODULATION_DESTINATION_COUNT (2)
+#define MODULATION_UNROUTED (P_COUNT)
+
+static const uint8_t modulationDestinations[MODULATION_DESTINATION_COUNT] = { P_VOLUME, P_FILTER_CUTOFF };
+
+static const uint8_t modulationAmounts[MODULATION_DESTINATION_COUNT][MODULATION_SOURCE_COUNT] = {
+	{ MODULATION_UNROUTED, P_LFO_VOLUME, P_VELOCITY_VOLUME, MODULATION_UNROUTED }, // The envelope already shapes the amplitude.
+	{ P_FILTER_ENVELOPE, P_LFO_CUTOFF, P_VELOCITY_CUTOFF, P_BRIGHTNESS_CUTOFF },
+};
+
+// Per-note expressions. Each voice's expressions are smoothed towards their targets with a one-pole filter, stepped once per envelope chunk.
+// The new value of an expression event is held as pending, with the event's frame, and the renderer makes it the target in the chunk containing that frame.
+// Each voice holds one pending value per expression, so the block is only split when a voice's is still due in an earlier chunk,
+// at the start of the new event's chunk. Dense MPE streams stay chunk accurate, and sparse ones do not split the block at all.
+#define EXPRESSION_VOLUME (0) // An amplitude multiplier, in [0, 4].
+#define EXPRESSION_PAN (1) // In [0, 1], where 0.5 is the centre.
+#define EXPRESSION_PITCH (2) // A multiplier of the phase increments, from the tuning in semitones.
+#define EXPRESSION_BRIGHTNESS (3) // In [-1, 1], mapped from [0, 1]. A modulation source.
+#define EXPRESSION_COUNT (4)
+#define EXPRESSION_SMOOTHING_TIME (0.005f) // The time constant, in seconds.
+#define EXPRESSION_SNAP_THRESHOLD (1e-4f) // A pan this close to its target is snapped to it.
+#define EXPRESSION_TUNING_RANGE (120.0f) // The tuning expression is clamped to this many semitones either way.
+#define EXPRESSION_MAXIMUM_INCREMENT (0.49f) // Tuned phase increments are clamped below Nyquist, in cycles per sample, so a single subtraction wraps the phase.
+
+static const float expressionDefaults[EXPRESSION_COUNT] = { 1.0f, 0.5f, 1.0f, 0.0f };
+
+// The convolution reverb on the master bus, using uniformly partitioned overlap-save convolution in two stages.
+// The head of the impulse response is convolved on the audio thread in small blocks, and the rest on the reverb thread in large blocks.
+// The head covers the first 2 * REVERB_TAIL_SIZE samples, so the reverb thread has one tail block of time to finish each block.
+#define REVERB_HEAD_SIZE (128) // Also the latency of the wet signal.
+#define REVERB_TAIL_SIZE (4096)
+#define REVERB_MAXIMUM_LENGTH (10.0f) // In seconds.
+#define REVERB_TAIL_SLOTS (3)
+// Measured with clap-tutorial-benchmark.cpp (AVX2, 48 kHz), in cycles per sample, the median of 5 runs on the machine above:
+// 170 to 210 on the audio thread at any length, and 115, 235 and 375 on the reverb thread for 1, 4 and 10 second impulse responses.
+static_assert(REVERB_TAIL_SIZE % REVERB_HEAD_SIZE == 0, "Tail blocks must start on head block boundaries.");
+
+// The modulated stereo delay on the master bus, before the reverb. With a short delay time and some modulation depth it is a chorus.
+// Each channel has a power-of-two ring buffer, so positions wrap with a mask, and it is read with cubic interpolation.
+#define DELAY_MAXIMUM_TIME (1.0f) // In seconds.
+#define DELAY_MAXIMUM_DEPTH (0.01f) // In seconds, the most the modulation adds to the delay time.
+#define DELAY_MAXIMUM_FEEDBACK (0.95f)
+#define DELAY_MINIMUM_FRAMES (32) // So that every sample read while processing SIMD_WIDTH frames was written before them.
+#define DELAY_SILENCE_THRESHOLD (1e-5f)
+static_assert(DELAY_MINIMUM_FRAMES > SIMD_WIDTH + 1, "The interpolation reads one sample after the delayed position.");
+
+// Parameter events, exchanged between the main thread and the audio thread.
+// Values are coalesced in a change set, and only gestures are queued.
+#define PARAMETER_GESTURE_BEGIN (0)
+#define PARAMETER_VALUE (1)
+#define PARAMETER_GESTURE_END (2)
+#define PARAMETER_QUEUE_SIZE (256)
+#define PARAMETER_WORDS ((P_COUNT + 63) / 64)
+
+// Input events are read in batches. MIDI 1.0 and MIDI 2.0 messages are translated to CLAP note events as each batch is read,
+// so dispatching them costs the same as dispatching native events. Messages the synth has no use for are dropped.
+#define EVENT_BATCH_SIZE (256)
+#define MIDI_CHANNELS (16)
+#define MIDI_PITCH_BEND_RANGE (2.0f) // The default range, in semitones. Each channel's can be set with registered parameter 0.
+#define MIDI_REGISTERED_PARAMETER_NONE (0x3FFF)
+
+// Each process call is timed, and binned by its load: the fraction of the block's duration it took to process.
+// The last bucket holds all the loads above the others, and buckets from 1 / TIMING_BUCKET_WIDTH up are overloads.
+#define TIMING_BUCKET_COUNT (32)
+#define TIMING_BUCKET_WIDTH (0.05f)
+#define TIMING_LOG_VARIABLE "HELLOCLAP_TIMING_LOG" // If this environment variable is set, the histogram is appended to the file it names on destroy.
+
+// GUI size.
+#define GUI_WIDTH (300)
+#define GUI_HEIGHT (200)
+
+struct Voice {
+	bool held;
+	int32_t noteID;
+	int16_t channel, key;
+	uint32_t age; // Incremented for each new voice, to find the oldest.
+
+	float velocity;
+	float parameterOffsets[P_COUNT]; // The host's polyphonic modulation.
+};
+
+template <class T, uint32_t capacity>
+struct Queue {
+	// A wait-free single producer, single consumer ring buffer. The capacity must be a power of two.
+	T items[capacity];
+	std::atomic<uint32_t> head; // Only written by the consumer.
+	std::atomic<uint32_t> tail; // Only written by the producer.
+
+	bool Push(T item) {
+		uint32_t position = tail.load(std::memory_order_relaxed);
+		if (position - head.load(std::memory_order_acquire) == capacity) return false;
+		items[position & (capacity - 1)] = item;
+		tail.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T *item) {
+		uint32_t position = head.load(std::memory_order_relaxed);
+		if (position == tail.load(std::memory_order_acquire)) return false;
+		*item = items[position & (capacity - 1)];
+		head.store(position + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+union DecodedEvent {
+	clap_event_header_t header;
+	clap_event_note_t note;
+	clap_event_note_expression_t expression;
+};
+
+struct EventDecoder {
+	// The current batch. Native events are used in place, and translated MIDI is stored in decoded.
+	// Each input event gives at most one event in the batch, so a batch can cover more input events than it holds.
+	const clap_input_events_t *input;
+	uint32_t inputCount, inputPosition;
+	const clap_event_header_t *events[EVENT_BATCH_SIZE];
+	DecodedEvent decoded[EVENT_BATCH_SIZE];
+	uint32_t count, position;
+
+	// The MIDI state kept between blocks: each channel's selected registered parameter, and its pitch bend range.
+	uint16_t registeredParameter[MIDI_CHANNELS];
+	float pitchBendRange[MIDI_CHANNELS];
+};
+
+struct ParameterEvent {
+	uint32_t type, parameter;
+	float value;
+};
+
+struct ParameterChangeSet {
+	// A bitset of changed parameters, set by one thread and drained by the other.
+	// The summary has a bit for each word that may be non-zero, so draining costs O(changed parameters) rather than O(P_COUNT).
+	std::atomic<uint64_t> summary;
+	std::atomic<uint64_t> words[PARAMETER_WORDS];
+
+	void Mark(uint32_t parameter) {
+		// The word is set before the summary, so a concurrent Drain either sees both or leaves the bit for the next one.
+		words[parameter >> 6].fetch_or((uint64_t) 1 << (parameter & 63), std::memory_order_release);
+		summary.fetch_or((uint64_t) 1 << (parameter >> 6), std::memory_order_release);
+	}
+
+	bool Test(uint32_t parameter) {
+		return words[parameter >> 6].load(std::memory_order_acquire) & ((uint64_t) 1 << (parameter & 63));
+	}
+
+	template <class F>
+	void Drain(F callback) {
+		uint64_t summaryBits = summary.exchange(0, std::memory_order_acquire);
+
+		while (summaryBits) {
+			uint32_t word = CountTrailingZeros64(summaryBits);
+			summaryBits &= summaryBits - 1;
+			uint64_t bits = words[word].exchange(0, std::memory_order_acquire);
+
+			while (bits) {
+				callback(word * 64 + CountTrailingZeros64(bits));
+				bits &= bits - 1;
+			}
+		}
+	}
+};
+
+static_assert(PARAMETER_WORDS <= 64, "The change set summary is a single word.");
+
+struct ParameterRamp {
+	float value, target;
+	float step; // The increment per sample for a linear ramp, or the coefficient for a one-pole ramp.
+	uint32_t remaining; // The number of samples until the ramp reaches its target; zero if it has.
+	uint32_t frame; // The frame in the current block the ramp has been rendered up to.
+};
+
+#define VOICE_NONE (0xFFFFFFFF)
+#define VOICE_BUCKET_COUNT (16 * 128)
+
+struct VoiceNoteIDEntry {
+	int32_t noteID;
+	uint32_t voice; // VOICE_NONE if the entry is empty.
+};
+
+struct VoicePool {
+	// The arrays are allocated in activate, so that starting and stopping notes never allocates on the audio thread.
+	// The capacity is rounded up to a multiple of VOICE_GROUP_SIZE, so the renderer can always read whole groups.
+	// Voices [0, count) are active, and removing a voice moves the last voice into its slot.
+	uint32_t count, capacity;
+	uint32_t nextAge;
+	Voice *voices;
+
+	// Structure-of-arrays oscillator state, indexed in step with voices.
+	float *phase, *increment, *volume;
+	float *envelopeLevel, *envelopeStage;
+	float *wavetableOffset; // The start of the voice's mip level in its waveform's tables, chosen from its increment.
+
+	// The filter state. The coefficient is the value of tan(pi f / sampleRate) reached at the end of the last chunk.
+	float *filterCoefficient, *filterState1, *filterState2;
+
+	// The modulation matrix's sources, and the offset of the volume reached at the end of the last chunk.
+	// The host's modulation of each destination is gathered from the voices for each sub-block, since modulation events split the block.
+	float *velocity, *lfoPhase, *volumeOffset;
+	float *hostModulation[MODULATION_DESTINATION_COUNT];
+
+	// The note expressions: the smoothed value, the target it is moving towards, and the value from the last event, with the event's frame.
+	float *expression[EXPRESSION_COUNT], *expressionTarget[EXPRESSION_COUNT];
+	float *expressionPending[EXPRESSION_COUNT], *expressionFrame[EXPRESSION_COUNT];
+
+	// The sub-oscillators for unison, UNISON_MAXIMUM per voice. Unused sub-oscillators have a pan of zero.
+	// In unison, each sub-oscillator is filtered separately, which is equivalent to filtering the voice's panned sum in each channel.
+	float *unisonPhase, *unisonIncrement, *unisonPanL, *unisonPanR;
+	float *unisonFilterState1, *unisonFilterState2;
+
+	// The lookup index used to match note events to voices, updated whenever a voice is added, removed or moved.
+	// Voices with a note ID are in a linear probing hash table, and every voice is in a linked list for its (channel, key) bucket.
+	// A bitset marks the non-empty buckets, so that a wildcard key only visits the keys that are playing on the channel.
+	VoiceNoteIDEntry *noteIDTable;
+	uint32_t noteIDMask;
+	uint32_t *bucketNext, *bucketPrevious;
+	uint32_t bucketFirst[VOICE_BUCKET_COUNT];
+	uint64_t bucketOccupied[VOICE_BUCKET_COUNT / 64];
+	uint32_t *matches;
+};
+
+struct FFT {
+	// A radix-2 complex FFT, on separate real and imaginary arrays.
+	uint32_t size;
+	float *twiddleReal, *twiddleImaginary; // The twiddle factors for the stage combining pairs of transforms of size h are stored from index h.
+	uint32_t *reversed; // The bit-reversed index of each element.
+};
+
+struct ConvolverImpulse {
+	// The spectra of an impulse response's partitions, [channel][partition][bin], scaled to include the inverse FFT's normalisation.
+	float *real, *imaginary;
+	uint32_t partitionCount;
+};
+
+struct Convolver {
+	// Uniformly partitioned overlap-save convolution, with mono input and stereo output.
+	// The input spectra of the last partitionCapacity blocks are kept in a ring.
+	// The signals are real, so only bins [0, blockSize] are stored, padded to binStride for whole vectors.
+	uint32_t blockSize, binStride, partitionCapacity, ring;
+	FFT fft;
+	float *window; // The last two input blocks.
+	float *spectraReal, *spectraImaginary; // [partitionCapacity][binStride]
+	float *real, *imaginary; // FFT workspace, 2 * blockSize.
+	float *sumReal, *sumImaginary; // [channel][binStride]
+};
+
+struct ReverbImpulse {
+	ConvolverImpulse head, tail;
+	float length; // In seconds.
+	uint32_t frameCount;
+};
+
+struct Reverb {
+	float sampleRate;
+	Convolver head, tail;
+
+	// The impulse responses are built on the reverb thread, which publishes a new one when the length parameter changes.
+	// The audio thread switches to it at the next tail block and acknowledges it; only then may the reverb thread replace the other one.
+	ReverbImpulse impulses[2];
+	uint32_t impulseActive; // Audio thread.
+	std::atomic<uint32_t> impulsePublished, impulseAcknowledged;
+	std::atomic<float> impulseRequested; // The length wanted by the audio thread, in seconds.
+	float *impulseSamples; // Workspace for generating impulse responses, [channel][frame].
+	float *impulseWorkspace; // Workspace for transforming them.
+
+	// Audio thread state.
+	uint64_t frames; // Frames processed since the reverb was last cleared.
+	uint64_t tailFirst; // The first tail block submitted since the reverb was last cleared.
+	bool bypassed; // Cleared before it is next used.
+	bool tailReady; // Whether the tail block being played was finished in time.
+	uint32_t silentFrames; // Consecutive frames of silent input, to know when the tail has died away.
+	float *headInput, *headOutput; // headOutput is [channel][REVERB_HEAD_SIZE].
+	std::atomic<uint32_t> tailBlocksMissed;
+
+	// Tail blocks are passed between the audio thread and the reverb thread in slots, indexed by block number.
+	// A block's output is still being played when the block two after it is processed, so three slots are needed.
+	float *tailInput[REVERB_TAIL_SLOTS], *tailOutput[REVERB_TAIL_SLOTS]; // tailOutput is [channel][REVERB_TAIL_SIZE].
+	uint32_t tailImpulse[REVERB_TAIL_SLOTS];
+	bool tailClear[REVERB_TAIL_SLOTS]; // Set for the first block after the reverb was cleared, so that the reverb thread clears the tail convolver.
+	std::atomic<uint64_t> tailSubmitted, tailCompleted;
+
+	Thread thread;
+	Semaphore wake;
+	std::atomic<bool> quit;
+	bool running;
+
+	// When rendering offline, the audio thread waits for the reverb thread instead of dropping late blocks.
+	bool offline; // Audio thread.
+	std::atomic<bool> waiting; // Set by the audio thread before it waits on finished.
+	Semaphore finished;
+};
+
+struct Delay {
+	float sampleRate;
+	float *buffers[2]; // Allocated in activate.
+	uint32_t mask; // The size of the buffers, minus one.
+	uint32_t position; // The next frame to write. Only the bits in mask are used to index the buffers.
+	float lfoPhase;
+	uint32_t quietFrames; // Consecutive frames where the input and output were below DELAY_SILENCE_THRESHOLD.
+	bool bypassed; // Cleared before it is next used.
+};
+
+// Worker threads started by the plugin for offline rendering, used when the host has no thread pool.
+struct RenderWorkers {
+	Thread threads[RENDER_TASK_COUNT - 1]; // The audio thread runs tasks too.
+	Semaphore start, done;
+	std::atomic<uint32_t> nextTask;
+	uint32_t taskCount;
+	std::atomic<bool> quit;
+	bool running;
+};
+
+static float sineTable[SINE_TABLE_SIZE + 2]; // Guard entries for interpolating at phase 1.
+
+static Mutex wavetablesMutex;
+static uint32_t wavetablesReferences;
+static float *wavetables; // [WAVEFORM_COUNT][WAVETABLE_LEVELS][WAVETABLE_STRIDE], valid while wavetablesReferences is non-zero.
+
+struct MyPlugin {
+	clap_plugin_t plugin;
+	const clap_host_t *host;
+	float sampleRate;
+	uint32_t sineKernel;
+	uint32_t eventQuantum;
+	float keyFrequencies[128]; // The tuning table, built in activate.
+	float filterTable[FILTER_TABLE_SIZE + 2]; // The filter coefficient across the cutoff parameter's range, built in activate.
+	uint32_t randomState; // For the sub-oscillators' starting phases.
+	const float *wavetables; // Shared by all instances.
+	VoicePool voices;
+	std::atomic<uint32_t> voicesStolen;
+	uint32_t mainVoicesStolen;
+	std::atomic<uint32_t> blocksSkipped; // Blocks where no voices were playing, so nothing was rendered.
+	Delay delay;
+	Reverb reverb;
+	uint32_t mainBlocksSkipped;
+
+	// The audio thread is the only writer of the timing counters, so they are updated without read-modify-write operations.
+	std::atomic<uint32_t> timingBuckets[TIMING_BUCKET_COUNT];
+	std::atomic<float> timingSecondMaximum; // The highest load during the last complete second of audio.
+	std::atomic<float> timingMaximum; // The highest load since the plugin was created.
+	float timingWindowMaximum; // Audio thread.
+	uint32_t timingWindowFrames; // Audio thread.
+	uint32_t mainTimingBuckets[TIMING_BUCKET_COUNT];
+	float mainTimingSecondMaximum;
+
+	float parameters[P_COUNT], mainParameters[P_COUNT];
+	float parameterModulation[P_COUNT]; // The host's monophonic modulation, added to every voice's own.
+	float channelExpressions[MIDI_CHANNELS][EXPRESSION_COUNT]; // The last expressions sent to whole channels, which notes start with.
+	EventDecoder eventDecoder;
+	ParameterRamp ramps[P_COUNT];
+	float *rampBuffers[P_COUNT]; // The per-sample values of each smoothed parameter for the current block, allocated in activate.
+	uint64_t rampsActive[PARAMETER_WORDS]; // Ramps that are moving or have been rendered in the current block.
+	uint32_t maximumFrameCount; // The size of the ramp buffers.
+	Queue<ParameterEvent, PARAMETER_QUEUE_SIZE> mainGestures;
+	ParameterChangeSet mainChanged, audioChanged; // Values set by one thread that the other has not picked up yet.
+	std::atomic<float> mainSnapshots[P_COUNT]; // The main thread's values, read by the audio thread for parameters in mainChanged.
+	std::atomic<float> parameterSnapshots[P_COUNT]; // The audio thread's values, for get_value and the main thread.
+	struct GUI *gui;
+	const clap_host_posix_fd_support_t *hostPOSIXFDSupport;
+	const clap_host_timer_support_t *hostTimerSupport;
+	const clap_host_params_t *hostParams;
+	const clap_host_tail_t *hostTail;
+	const clap_host_thread_pool_t *hostThreadPool;
+	float *renderScratch; // [task][channel][maximumFrameCount], allocated in activate.
+	const struct VoiceRenderInputs *renderInputs; // The sub-block being rendered by the thread pool.
+	uint32_t renderOscillator, renderFrameCount;
+	std::atomic<int32_t> renderMode; // Set on the main thread through the render extension.
+	bool offline; // The audio thread's copy of renderMode, taken at the start of each block.
+	RenderWorkers renderWorkers;
+	uint32_t processorCount; // Taken in activate.
+	uint32_t mainTail; // The tail length when the host was last told it changed.
+	bool mouseDragging;
+	uint32_t mouseDraggingParameter;
+	int32_t mouseDragOriginX, mouseDragOriginY;
+	float mouseDragOriginValue;
+	clap_id timerID;
+};
+
+static float FloatClamp01(float x) {
+	return x >= 1.0f ? 1.0f : x <= 0.0f ? 0.0f : x;
+}
+
+static void VoicePoolSetUnison(VoicePool *pool, uintptr_t index, uint32_t count, float detune, float spread) {
+	// The sub-oscillators are detuned evenly across [-detune, detune] semitones and panned across [-spread, spread] with constant power.
+	// Their level is scaled by 1 / sqrt(count), so the loudness roughly matches a single oscillator.
+	float *increment = pool->unisonIncrement + index * UNISON_MAXIMUM;
+	float *panL = pool->unisonPanL + index * UNISON_MAXIMUM, *panR = pool->unisonPanR + index * UNISON_MAXIMUM;
+	float level = 1.0f / sqrtf((float) count);
+
+	for (uint32_t i = 0; i < UNISON_MAXIMUM; i++) {
+		float position = count > 1 ? 2.0f * i / (count - 1) - 1.0f : 0.0f;
+		float angle = (position * spread + 1.0f) * 0.25f * 3.14159265358979f;
+		increment[i] = i < count ? pool->increment[index] * exp2f(position * detune / 12.0f) : 0.0f;
+		panL[i] = i < count ? cosf(angle) * level : 0.0f;
+		panR[i] = i < count ? sinf(angle) * level : 0.0f;
+	}
+}
+
+static float PluginGetUnisonDetune(MyPlugin *plugin, uint32_t *unisonCount) {
+	uint32_t count = (uint32_t) plugin->parameters[P_UNISON_VOICES];
+	*unisonCount = count < 1 ? 1 : count > UNISON_MAXIMUM ? UNISON_MAXIMUM : count;
+	return *unisonCount > 1 ? plugin->parameters[P_UNISON_DETUNE] : 0.0f;
+}
+
+static void PluginUpdateVoiceLevel(MyPlugin *plugin, uintptr_t index) {
+	// Use the first mip level without harmonics above Nyquist, for the highest sub-oscillator at the highest pitch the expression moves between.
+	// This is cheap enough to redo for every tuning expression event.
+	VoicePool *pool = &plugin->voices;
+	uint32_t unisonCount;
+	float detune = PluginGetUnisonDetune(plugin, &unisonCount);
+	float pitch = fmaxf(pool->expression[EXPRESSION_PITCH][index], fmaxf(pool->expressionTarget[EXPRESSION_PITCH][index], pool->expressionPending[EXPRESSION_PITCH][index]));
+	float harmonicLimit = 0.5f / (pool->increment[index] * pitch * exp2f(detune / 12.0f));
+	uint32_t level = 0;
+	while (level < WAVETABLE_LEVELS - 1 && ((WAVETABLE_SIZE / 2) >> level) > harmonicLimit) level++;
+	pool->wavetableOffset[index] = level * WAVETABLE_STRIDE;
+}
+
+static void PluginUpdateVoicePitch(MyPlugin *plugin, uintptr_t index) {
+	// The phase increment is cached, and only recomputed when the key's frequency, the unison settings or the sample rate changes.
+	// The tuning expression is applied by the renderer, as a multiplier of the increments.
+	Voice *voice = &plugin->voices.voices[index];
+	plugin->voices.increment[index] = plugin->keyFrequencies[voice->key & 127] / plugin->sampleRate;
+
+	uint32_t unisonCount;
+	float detune = PluginGetUnisonDetune(plugin, &unisonCount);
+	VoicePoolSetUnison(&plugin->voices, index, unisonCount, detune, plugin->parameters[P_UNISON_SPREAD]);
+	PluginUpdateVoiceLevel(plugin, index);
+}
+
+static void PluginBuildTuningTable(MyPlugin *plugin) {
+	// Equal temperament. Any other 128-key tuning can be written into keyFrequencies, followed by PluginUpdateVoicePitch for each voice.
+	for (uint32_t i = 0; i < 128; i++) {
+		plugin->keyFrequencies[i] = 440.0f * exp2f((i - 57.0f) / 12.0f);
+	}
+}
+
+static void FilterTableBuild(float *table, float sampleRate) {
+	// Frequencies above 0.49 of the sample rate are clamped, since the coefficient goes to infinity at Nyquist.
+	for (uint32_t i = 0; i < FILTER_TABLE_SIZE + 2; i++) {
+		float frequency = fminf(FILTER_MINIMUM_FREQUENCY * exp2f(FILTER_OCTAVES * i / FILTER_TABLE_SIZE), 0.49f * sampleRate);
+		table[i] = tanf(3.14159265358979f * frequency / sampleRate);
+	}
+}
+
+static float FilterTableRead(const float *table, float cutoff) {
+	float position = FloatClamp01(cutoff) * FILTER_TABLE_SIZE;
+	uint32_t index = (uint32_t) position;
+	return table[index] + (table[index + 1] - table[index]) * (position - index);
+}
+
+static inline uint32_t VoiceBucket(int16_t channel, int16_t key) {
+	return ((channel & 15) << 7) | (key & 127);
+}
+
+static inline uint32_t VoiceNoteIDHash(VoicePool *pool, int32_t noteID) {
+	return ((uint32_t) noteID * 0x9E3779B1) & pool->noteIDMask;
+}
+
+static void VoicePoolClear(VoicePool *pool) {
+	pool->count = 0;
+	for (uint32_t i = 0; i <= pool->noteIDMask; i++) pool->noteIDTable[i].voice = VOICE_NONE;
+	for (uint32_t i = 0; i < VOICE_BUCKET_COUNT; i++) pool->bucketFirst[i] = VOICE_NONE;
+	for (uint32_t i = 0; i < VOICE_BUCKET_COUNT / 64; i++) pool->bucketOccupied[i] = 0;
+	for (uint32_t i = 0; i < pool->capacity; i++) pool->volume[i] = 0.0f;
+	for (uint32_t i = 0; i < pool->capacity; i++) pool->envelopeLevel[i] = 0.0f;
+	for (uint32_t i = 0; i < pool->capacity; i++) pool->envelopeStage[i] = ENVELOPE_FINISHED;
+
+	for (uint32_t i = 0; i < EXPRESSION_COUNT; i++) {
+		for (uint32_t j = 0; j < pool->capacity; j++) {
+			pool->expression[i][j] = pool->expressionTarget[i][j] = pool->expressionPending[i][j] = expressionDefaults[i];
+		}
+	}
+}
+
+static void VoicePoolAllocate(VoicePool *pool, uint32_t capacity) {
+	capacity = (capacity + VOICE_GROUP_SIZE - 1) / VOICE_GROUP_SIZE * VOICE_GROUP_SIZE;
+	uint32_t noteIDTableSize = 1;
+	while (noteIDTableSize < capacity * 2) noteIDTableSize *= 2;
+
+	pool->capacity = capacity;
+	pool->voices = (Voice *) calloc(capacity, sizeof(Voice));
+	pool->phase = (float *) calloc(capacity, sizeof(float));
+	pool->increment = (float *) calloc(capacity, sizeof(float));
+	pool->volume = (float *) calloc(capacity, sizeof(float));
+	pool->envelopeLevel = (float *) calloc(capacity, sizeof(float));
+	pool->envelopeStage = (float *) calloc(capacity, sizeof(float));
+	pool->wavetableOffset = (float *) calloc(capacity, sizeof(float));
+	pool->filterCoefficient = (float *) calloc(capacity, sizeof(float));
+	pool->filterState1 = (float *) calloc(capacity, sizeof(float));
+	pool->filterState2 = (float *) calloc(capacity, sizeof(float));
+	pool->velocity = (float *) calloc(capacity, sizeof(float));
+	pool->lfoPhase = (float *) calloc(capacity, sizeof(float));
+	pool->volumeOffset = (float *) calloc(capacity, sizeof(float));
+	for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) pool->hostModulation[i] = (float *) calloc(capacity, sizeof(float));
+
+	for (uint32_t i = 0; i < EXPRESSION_COUNT; i++) {
+		pool->expression[i] = (float *) calloc(capacity, sizeof(float));
+		pool->expressionTarget[i] = (float *) calloc(capacity, sizeof(float));
+		pool->expressionPending[i] = (float *) calloc(capacity, sizeof(float));
+		pool->expressionFrame[i] = (float *) calloc(capacity, sizeof(float));
+	}
+
+	pool->unisonPhase = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->unisonIncrement = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->unisonPanL = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->unisonPanR = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->unisonFilterState1 = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->unisonFilterState2 = (float *) calloc(capacity * UNISON_MAXIMUM, sizeof(float));
+	pool->noteIDTable = (VoiceNoteIDEntry *) calloc(noteIDTableSize, sizeof(VoiceNoteIDEntry));
+	pool->noteIDMask = noteIDTableSize - 1;
+	pool->bucketNext = (uint32_t *) calloc(capacity, sizeof(uint32_t));
+	pool->bucketPrevious = (uint32_t *) calloc(capacity, sizeof(uint32_t));
+	pool->matches = (uint32_t *) calloc(capacity, sizeof(uint32_t));
+	VoicePoolClear(pool);
+}
+
+static void VoicePoolFree(VoicePool *pool) {
+	free(pool->voices);
+	free(pool->phase);
+	free(pool->increment);
+	free(pool->volume);
+	free(pool->envelopeLevel);
+	free(pool->envelopeStage);
+	free(pool->wavetableOffset);
+	free(pool->filterCoefficient);
+	free(pool->filterState1);
+	free(pool->filterState2);
+	free(pool->velocity);
+	free(pool->lfoPhase);
+	free(pool->volumeOffset);
+	for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) free(pool->hostModulation[i]);
+
+	for (uint32_t i = 0; i < EXPRESSION_COUNT; i++) {
+		free(pool->expression[i]);
+		free(pool->expressionTarget[i]);
+		free(pool->expressionPending[i]);
+		free(pool->expressionFrame[i]);
+	}
+
+	free(pool->unisonPhase);
+	free(pool->unisonIncrement);
+	free(pool->unisonPanL);
+	free(pool->unisonPanR);
+	free(pool->unisonFilterState1);
+	free(pool->unisonFilterState2);
+	free(pool->noteIDTable);
+	free(pool->bucketNext);
+	free(pool->bucketPrevious);
+	free(pool->matches);
+	*pool = {};
+}
+
+static VoiceNoteIDEntry *VoicePoolFindNoteIDEntry(VoicePool *pool, uint32_t index) {
+	int32_t noteID = pool->voices[index].noteID;
+
+	for (uint32_t i = VoiceNoteIDHash(pool, noteID); ; i = (i + 1) & pool->noteIDMask) {
+		assert(pool->noteIDTable[i].voice != VOICE_NONE);
+		if (pool->noteIDTable[i].voice == index) return &pool->noteIDTable[i];
+	}
+}
+
+static void VoicePoolIndexAdd(VoicePool *pool, uint32_t index) {
+	Voice *voice = &pool->voices[index];
+
+	if (voice->noteID != -1) {
+		uint32_t i = VoiceNoteIDHash(pool, voice->noteID);
+		while (pool->noteIDTable[i].voice != VOICE_NONE) i = (i + 1) & pool->noteIDMask;
+		pool->noteIDTable[i].noteID = voice->noteID;
+		pool->noteIDTable[i].voice = index;
+	}
+
+	uint32_t bucket = VoiceBucket(voice->channel, voice->key);
+	uint32_t first = pool->bucketFirst[bucket];
+	pool->bucketNext[index] = first;
+	pool->bucketPrevious[index] = VOICE_NONE;
+	if (first != VOICE_NONE) pool->bucketPrevious[first] = index;
+	pool->bucketFirst[bucket] = index;
+	pool->bucketOccupied[bucket / 64] |= (uint64_t) 1 << (bucket % 64);
+}
+
+static void VoicePoolIndexRemove(VoicePool *pool, uint32_t index) {
+	Voice *voice = &pool->voices[index];
+
+	if (voice->noteID != -1) {
+		// Backward shift deletion, which keeps probe sequences intact without tombstones.
+		uint32_t hole = VoicePoolFindNoteIDEntry(pool, index) - pool->noteIDTable;
+
+		for (uint32_t i = (hole + 1) & pool->noteIDMask; pool->noteIDTable[i].voice != VOICE_NONE; i = (i + 1) & pool->noteIDMask) {
+			uint32_t home = VoiceNoteIDHash(pool, pool->noteIDTable[i].noteID);
+
+			if (((i - home) & pool->noteIDMask) >= ((i - hole) & pool->noteIDMask)) {
+				pool->noteIDTable[hole] = pool->noteIDTable[i];
+				hole = i;
+			}
+		}
+
+		pool->noteIDTable[hole].voice = VOICE_NONE;
+	}
+
+	uint32_t bucket = VoiceBucket(voice->channel, voice->key);
+	uint32_t next = pool->bucketNext[index], previous = pool->bucketPrevious[index];
+	if (next != VOICE_NONE) pool->bucketPrevious[next] = previous;
+	if (previous != VOICE_NONE) pool->bucketNext[previous] = next;
+	else pool->bucketFirst[bucket] = next;
+	if (pool->bucketFirst[bucket] == VOICE_NONE) pool->bucketOccupied[bucket / 64] &= ~((uint64_t) 1 << (bucket % 64));
+}
+
+static void VoicePoolIndexMove(VoicePool *pool, uint32_t from, uint32_t to) {
+	// Called after the voice has been copied from one slot to the other.
+	if (pool->voices[to].noteID != -1) {
+		VoicePoolFindNoteIDEntry(pool, from)->voice = to;
+	}
+
+	uint32_t next = pool->bucketNext[from], previous = pool->bucketPrevious[from];
+	pool->bucketNext[to] = next;
+	pool->bucketPrevious[to] = previous;
+	if (next != VOICE_NONE) pool->bucketPrevious[next] = to;
+	if (previous != VOICE_NONE) pool->bucketNext[previous] = to;
+	else pool->bucketFirst[VoiceBucket(pool->voices[to].channel, pool->voices[to].key)] = to;
+}
+
+static void VoicePoolRemove(VoicePool *pool, uintptr_t index) {
+	assert(index < pool->count);
+	uintptr_t last = --pool->count;
+	VoicePoolIndexRemove(pool, index);
+
+	if (index != last) {
+		pool->voices[index] = pool->voices[last];
+		pool->phase[index] = pool->phase[last];
+		pool->increment[index] = pool->increment[last];
+		pool->volume[index] = pool->volume[last];
+		pool->envelopeLevel[index] = pool->envelopeLevel[last];
+		pool->envelopeStage[index] = pool->envelopeStage[last];
+		pool->wavetableOffset[index] = pool->wavetableOffset[last];
+		pool->filterCoefficient[index] = pool->filterCoefficient[last];
+		pool->filterState1[index] = pool->filterState1[last];
+		pool->filterState2[index] = pool->filterState2[last];
+		pool->velocity[index] = pool->velocity[last];
+		pool->lfoPhase[index] = pool->lfoPhase[last];
+		pool->volumeOffset[index] = pool->volumeOffset[last];
+
+		for (uint32_t i = 0; i < EXPRESSION_COUNT; i++) {
+			pool->expression[i][index] = pool->expression[i][last];
+			pool->expressionTarget[i][index] = pool->expressionTarget[i][last];
+			pool->expressionPending[i][index] = pool->expressionPending[i][last];
+			pool->expressionFrame[i][index] = pool->expressionFrame[i][last];
+		}
+
+		memcpy(pool->unisonPhase + index * UNISON_MAXIMUM, pool->unisonPhase + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		memcpy(pool->unisonIncrement + index * UNISON_MAXIMUM, pool->unisonIncrement + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		memcpy(pool->unisonPanL + index * UNISON_MAXIMUM, pool->unisonPanL + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		memcpy(pool->unisonPanR + index * UNISON_MAXIMUM, pool->unisonPanR + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		memcpy(pool->unisonFilterState1 + index * UNISON_MAXIMUM, pool->unisonFilterState1 + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		memcpy(pool->unisonFilterState2 + index * UNISON_MAXIMUM, pool->unisonFilterState2 + last * UNISON_MAXIMUM, UNISON_MAXIMUM * sizeof(float));
+		VoicePoolIndexMove(pool, last, index);
+	}
+
+	// Keep the now unused lane silent.
+	pool->volume[last] = 0.0f;
+	pool->envelopeLevel[last] = 0.0f;
+	pool->envelopeStage[last] = ENVELOPE_FINISHED;
+}
+
+static void VoicePoolAddMatch(VoicePool *pool, uint32_t *matchCount, uint32_t index, int32_t noteID, int16_t channel, int16_t key) {
+	Voice *voice = &pool->voices[index];
+
+	if ((key == -1 || voice->key == key) && (noteID == -1 || voice->noteID == noteID) && (channel == -1 || voice->channel == channel)) {
+		// Keep the matches sorted in descending order.
+		uint32_t i = (*matchCount)++;
+		for (; i && pool->matches[i - 1] < index; i--) pool->matches[i] = pool->matches[i - 1];
+		pool->matches[i] = index;
+	}
+}
+
+static void VoicePoolAddBucketMatches(VoicePool *pool, uint32_t *matchCount, uint32_t bucket, int32_t noteID, int16_t channel, int16_t key) {
+	for (uint32_t i = pool->bucketFirst[bucket]; i != VOICE_NONE; i = pool->bucketNext[i]) {
+		VoicePoolAddMatch(pool, matchCount, i, noteID, channel, key);
+	}
+}
+
+static uint32_t VoicePoolMatch(VoicePool *pool, int32_t noteID, int16_t channel, int16_t key) {
+	// Finds the voices matching a note event, where -1 is a wildcard, and puts them in pool->matches.
+	// The matches are in descending order, so the caller can remove each voice as it goes.
+	uint32_t matchCount = 0;
+
+	if (!pool->capacity) {
+		// Not activated.
+	} else if (noteID != -1) {
+		for (uint32_t i = VoiceNoteIDHash(pool, noteID); pool->noteIDTable[i].voice != VOICE_NONE; i = (i + 1) & pool->noteIDMask) {
+			if (pool->noteIDTable[i].noteID == noteID) {
+				VoicePoolAddMatch(pool, &matchCount, pool->noteIDTable[i].voice, noteID, channel, key);
+			}
+		}
+	} else if (channel != -1 && key != -1) {
+		VoicePoolAddBucketMatches(pool, &matchCount, VoiceBucket(channel, key), noteID, channel, key);
+	} else if (channel != -1) {
+		for (uint32_t i = VoiceBucket(channel, 0) / 64; i <= VoiceBucket(channel, 127) / 64; i++) {
+			for (uint64_t bits = pool->bucketOccupied[i]; bits; bits &= bits - 1) {
+				VoicePoolAddBucketMatches(pool, &matchCount, i * 64 + CountTrailingZeros64(bits), noteID, channel, key);
+			}
+		}
+	} else if (key != -1) {
+		for (int16_t i = 0; i < 16; i++) {
+			VoicePoolAddBucketMatches(pool, &matchCount, VoiceBucket(i, key), noteID, channel, key);
+		}
+	} else {
+		for (uint32_t i = pool->count; i; i--) {
+			pool->matches[matchCount++] = i - 1;
+		}
+	}
+
+	return matchCount;
+}
+
+static uintptr_t VoicePoolFindVictim(VoicePool *pool, uint32_t policy, float volume, int16_t channel, int16_t key) {
+	// Voices that have already been released are always taken first.
+	uintptr_t victim = 0;
+	bool foundSameKey = false;
+
+	for (uintptr_t i = 0; i < pool->count; i++) {
+		Voice *voice = &pool->voices[i];
+		Voice *best = &pool->voices[victim];
+
+		if (voice->held != best->held) {
+			if (!voice->held) victim = i;
+			continue;
+		}
+
+		if (policy == VOICE_STEAL_QUIETEST) {
+			// Voices share the volume parameter, and only differ by their envelope, modulation and volume expression.
+			float loudness = pool->envelopeLevel[i] * FloatClamp01(volume + pool->volumeOffset[i]) * pool->expression[EXPRESSION_VOLUME][i];
+			float bestLoudness = pool->envelopeLevel[victim] * FloatClamp01(volume + pool->volumeOffset[victim]) * pool->expression[EXPRESSION_VOLUME][victim];
+			if (loudness < bestLoudness) victim = i;
+		} else if (policy == VOICE_STEAL_SAME_KEY) {
+			bool sameKey = voice->key == key && voice->channel == channel;
+			if (sameKey && !foundSameKey) victim = i, foundSameKey = true;
+			else if (sameKey == foundSameKey && (int32_t) (voice->age - best->age) < 0) victim = i;
+		} else {
+			if ((int32_t) (voice->age - best->age) < 0) victim = i;
+		}
+	}
+
+	return victim;
+}
+
+static void PluginSendNoteEnd(Voice *voice, const clap_output_events_t *out) {
+	clap_event_note_t event = {};
+	event.header.size = sizeof(event);
+	event.header.time = 0;
+	event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+	event.header.type = CLAP_EVENT_NOTE_END;
+	event.header.flags = 0;
+	event.key = voice->key;
+	event.note_id = voice->noteID;
+	event.channel = voice->channel;
+	event.port_index = 0;
+	out->try_push(out, &event.header);
+}
+
+static void PluginStartVoice(MyPlugin *plugin, Voice voice, const clap_output_events_t *out) {
+	VoicePool *pool = &plugin->voices;
+	uintptr_t index;
+
+	if (pool->count == pool->capacity) {
+		if (!pool->count) return; // Not activated.
+		index = VoicePoolFindVictim(pool, (uint32_t) plugin->parameters[P_VOICE_STEALING], plugin->parameters[P_VOLUME], voice.channel, voice.key);
+		PluginSendNoteEnd(&pool->voices[index], out);
+		VoicePoolIndexRemove(pool, index);
+		plugin->voicesStolen.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		index = pool->count++;
+	}
+
+	voice.age = pool->nextAge++;
+	pool->voices[index] = voice;
+	pool->phase[index] = 0.0f;
+	pool->volume[index] = 0.2f;
+	pool->envelopeLevel[index] = 0.0f;
+	pool->envelopeStage[index] = ENVELOPE_ATTACK;
+	pool->filterCoefficient[index] = FilterTableRead(plugin->filterTable, plugin->ramps[P_FILTER_CUTOFF].value);
+	pool->filterState1[index] = pool->filterState2[index] = 0.0f;
+	pool->velocity[index] = voice.velocity;
+	pool->lfoPhase[index] = 0.0f;
+	pool->volumeOffset[index] = 0.0f;
+
+	const float *expressions = voice.channel >= 0 && voice.channel < MIDI_CHANNELS ? plugin->channelExpressions[voice.channel] : expressionDefaults;
+
+	for (uint32_t i = 0; i < EXPRESSION_COUNT; i++) {
+		pool->expression[i][index] = pool->expressionTarget[i][index] = pool->expressionPending[i][index] = expressions[i];
+		pool->expressionFrame[i][index] = 0.0f;
+	}
+
+	for (uint32_t i = 0; i < UNISON_MAXIMUM; i++) {
+		// Start the sub-oscillators at random phases, as free-running oscillators would be.
+		plugin->randomState = plugin->randomState * 1664525 + 1013904223;
+		pool->unisonPhase[index * UNISON_MAXIMUM + i] = (plugin->randomState >> 8) * (1.0f / (1 << 24));
+		pool->unisonFilterState1[index * UNISON_MAXIMUM + i] = pool->unisonFilterState2[index * UNISON_MAXIMUM + i] = 0.0f;
+	}
+
+	VoicePoolIndexAdd(pool, index);
+	PluginUpdateVoicePitch(plugin, index);
+}
+
+struct EnvelopeCoefficients {
+	// For advancing the envelopes by one chunk.
+	float attackStep, decayMultiplier, sustain, releaseMultiplier;
+};
+
+static EnvelopeCoefficients PluginEnvelopeCoefficients(MyPlugin *plugin, uint32_t frameCount) {
+	// The attack is linear; the decay and release are exponential, reaching ENVELOPE_THRESHOLD after their time.
+	float minimumTime = 1.0f / plugin->sampleRate;
+	float attack = fmaxf(plugin->parameters[P_ATTACK], minimumTime) * plugin->sampleRate;
+	float decay = fmaxf(plugin->parameters[P_DECAY], minimumTime) * plugin->sampleRate;
+	float release = fmaxf(plugin->parameters[P_RELEASE], minimumTime) * plugin->sampleRate;
+
+	EnvelopeCoefficients coefficients;
+	coefficients.attackStep = frameCount / attack;
+	coefficients.decayMultiplier = expf(logf(ENVELOPE_THRESHOLD) * frameCount / decay);
+	coefficients.sustain = plugin->parameters[P_SUSTAIN];
+	coefficients.releaseMultiplier = expf(logf(ENVELOPE_THRESHOLD) * frameCount / release);
+	return coefficients;
+}
+
+static inline SIMDFloat EnvelopeAdvance(SIMDFloat *level, SIMDFloat *stage, const EnvelopeCoefficients *coefficients) {
+	// Computes every stage's next level, and selects the one for each lane's stage, starting from the last stage.
+	SIMDFloat zero = SIMDBroadcast(0.0f), one = SIMDBroadcast(1.0f), threshold = SIMDBroadcast(ENVELOPE_THRESHOLD);
+	SIMDFloat sustain = SIMDBroadcast(coefficients->sustain);
+	SIMDFloat attackLevel = SIMDAdd(*level, SIMDBroadcast(coefficients->attackStep));
+	SIMDFloat decayLevel = SIMDMulAdd(SIMDSub(*level, sustain), SIMDBroadcast(coefficients->decayMultiplier), sustain);
+	SIMDFloat releaseLevel = SIMDMul(*level, SIMDBroadcast(coefficients->releaseMultiplier));
+
+	SIMDFloat next = zero, advance = zero;
+	SIMDMask inRelease = SIMDLessThan(*stage, SIMDBroadcast(ENVELOPE_RELEASE + 0.5f));
+	next = SIMDSelect(inRelease, releaseLevel, next);
+	advance = SIMDSelect(inRelease, SIMDSelect(SIMDLessThan(releaseLevel, threshold), one, zero), advance);
+	SIMDMask inSustain = SIMDLessThan(*stage, SIMDBroadcast(ENVELOPE_SUSTAIN + 0.5f));
+	next = SIMDSelect(inSustain, sustain, next);
+	advance = SIMDSelect(inSustain, zero, advance);
+	SIMDMask inDecay = SIMDLessThan(*stage, SIMDBroadcast(ENVELOPE_DECAY + 0.5f));
+	next = SIMDSelect(inDecay, decayLevel, next);
+	advance = SIMDSelect(inDecay, SIMDSelect(SIMDLessThan(SIMDSub(decayLevel, sustain), threshold), one, zero), advance);
+	SIMDMask inAttack = SIMDLessThan(*stage, SIMDBroadcast(ENVELOPE_ATTACK + 0.5f));
+	next = SIMDSelect(inAttack, SIMDMin(attackLevel, one), next);
+	advance = SIMDSelect(inAttack, SIMDSelect(SIMDLessThan(attackLevel, one), zero, one), advance);
+
+	SIMDFloat previous = *level;
+	*level = next;
+	*stage = SIMDAdd(*stage, advance);
+	return previous;
+}
+
+static void PluginRenderRamp(MyPlugin *plugin, uint32_t parameter, uint32_t end) {
+	// Advances the ramp up to the given frame of the current block, writing its values into the parameter's buffer.
+	ParameterRamp *ramp = &plugin->ramps[parameter];
+	float *buffer = plugin->rampBuffers[parameter];
+	uint32_t frame = ramp->frame;
+	if (frame >= end) return;
+	plugin->rampsActive[parameter >> 6] |= (uint64_t) 1 << (parameter & 63);
+
+	if (ramp->remaining) {
+		uint32_t count = end - frame < ramp->remaining ? end - frame : ramp->remaining;
+		float value = ramp->value, target = ramp->target, step = ramp->step;
+
+		if (parameterSmoothing[parameter] == PARAMETER_SMOOTHING_LINEAR) {
+			for (uint32_t i = 0; i < count; i++) { value += step; if (buffer) buffer[frame + i] = value; }
+		} else {
+			for (uint32_t i = 0; i < count; i++) { value += (target - value) * step; if (buffer) buffer[frame + i] = value; }
+		}
+
+		ramp->remaining -= count;
+		frame += count;
+
+		if (!ramp->remaining) {
+			value = target;
+			if (buffer) buffer[frame - 1] = value;
+		}
+
+		ramp->value = value;
+	}
+
+	if (buffer) {
+		for (; frame < end; frame++) buffer[frame] = ramp->value;
+	}
+
+	ramp->frame = end;
+}
+
+static void PluginSetRampTarget(MyPlugin *plugin, uint32_t parameter, float target, uint32_t time) {
+	// The ramp starts from its value at the event's time, so parameter events do not need to split the block.
+	ParameterRamp *ramp = &plugin->ramps[parameter];
+	PluginRenderRamp(plugin, parameter, time);
+
+	uint32_t smoothing = parameterSmoothing[parameter];
+	uint32_t length = smoothing == PARAMETER_SMOOTHING_NONE ? 0 : (uint32_t) (PARAMETER_SMOOTHING_TIME * plugin->sampleRate);
+	float difference = target - ramp->value;
+	ramp->target = target;
+
+	if (!length || fabsf(difference) < PARAMETER_SMOOTHING_THRESHOLD) {
+		ramp->value = target;
+		ramp->remaining = 0;
+	} else if (smoothing == PARAMETER_SMOOTHING_LINEAR) {
+		ramp->step = difference / length;
+		ramp->remaining = length;
+	} else {
+		ramp->step = 1.0f - expf(-4.0f / length);
+		ramp->remaining = (uint32_t) ceilf(logf(PARAMETER_SMOOTHING_THRESHOLD / fabsf(difference)) / logf(1.0f - ramp->step));
+	}
+
+	if (ramp->remaining) {
+		plugin->rampsActive[parameter >> 6] |= (uint64_t) 1 << (parameter & 63);
+	}
+}
+
+static void PluginSnapRamps(MyPlugin *plugin) {
+	for (uint32_t i = 0; i < P_COUNT; i++) {
+		plugin->ramps[i] = {};
+		plugin->ramps[i].value = plugin->ramps[i].target = plugin->parameters[i];
+	}
+
+	for (uint32_t i = 0; i < PARAMETER_WORDS; i++) {
+		plugin->rampsActive[i] = 0;
+	}
+}
+
+static void PluginFinishRamps(MyPlugin *plugin, uint32_t frameCount) {
+	// Only visits the ramps that were used in this block, or that are still moving.
+	for (uint32_t i = 0; i < PARAMETER_WORDS; i++) {
+		uint64_t bits = plugin->rampsActive[i];
+
+		while (bits) {
+			uint32_t parameter = i * 64 + CountTrailingZeros64(bits);
+			bits &= bits - 1;
+			PluginRenderRamp(plugin, parameter, frameCount);
+			plugin->ramps[parameter].frame = 0;
+
+			if (!plugin->ramps[parameter].remaining) {
+				plugin->rampsActive[i] &= ~((uint64_t) 1 << (parameter & 63));
+			}
+		}
+	}
+}
+
+static void ReverbSetLength(Reverb *reverb, float length);
+
+static void PluginApplyParameter(MyPlugin *plugin, uint32_t parameter, float value, uint32_t time) {
+	// Sets a parameter on the audio thread, from the host or the main thread.
+	plugin->parameters[parameter] = value;
+	plugin->parameterSnapshots[parameter].store(value, std::memory_order_relaxed);
+	PluginSetRampTarget(plugin, parameter, value, time);
+
+	if (parameter == P_UNISON_VOICES || parameter == P_UNISON_DETUNE || parameter == P_UNISON_SPREAD) {
+		for (uint32_t i = 0; i < plugin->voices.count; i++) {
+			PluginUpdateVoicePitch(plugin, i);
+		}
+	} else if (parameter == P_REVERB_LENGTH) {
+		ReverbSetLength(&plugin->reverb, value);
+	}
+}
+
+static DecodedEvent *EventDecoderAdd(EventDecoder *decoder, const clap_event_header_t *source, uint16_t type, uint32_t size) {
+	DecodedEvent *event = &decoder->decoded[decoder->count];
+	event->header = { .size = size, .time = source->time, .space_id = CLAP_CORE_EVENT_SPACE_ID, .type = type, .flags = source->flags };
+	decoder->events[decoder->count++] = &event->header;
+	return event;
+}
+
+static void EventDecoderNote(EventDecoder *decoder, const clap_event_header_t *source, uint16_t type, int16_t channel, int16_t key, float velocity) {
+	clap_event_note_t *note = &EventDecoderAdd(decoder, source, type, sizeof(clap_event_note_t))->note;
+	note->note_id = -1;
+	note->port_index = 0;
+	note->channel = channel;
+	note->key = key;
+	note->velocity = velocity;
+}
+
+static void EventDecoderExpression(EventDecoder *decoder, const clap_event_header_t *source, clap_note_expression expressionID, 
+		int16_t channel, int16_t key, float value) {
+	clap_event_note_expression_t *expression = &EventDecoderAdd(decoder, source, CLAP_EVENT_NOTE_EXPRESSION, sizeof(clap_event_note_expression_t))->expression;
+	expression->expression_id = expressionID;
+	expression->note_id = -1;
+	expression->port_index = 0;
+	expression->channel = channel;
+	expression->key = key;
+	expression->value = value;
+}
+
+static void EventDecoderControl(EventDecoder *decoder, const clap_event_header_t *source, int16_t channel, int16_t key, uint32_t index, float value) {
+	// A control change, or a MIDI 2.0 per-note controller if key is not -1. The value is in [0, 1], with 0.5 the centre.
+	if (index == 10) {
+		EventDecoderExpression(decoder, source, CLAP_NOTE_EXPRESSION_PAN, channel, key, value);
+	} else if (index == 74) {
+		EventDecoderExpression(decoder, source, CLAP_NOTE_EXPRESSION_BRIGHTNESS, channel, key, value);
+	} else if (index == 120 && key == -1) {
+		EventDecoderNote(decoder, source, CLAP_EVENT_NOTE_CHOKE, channel, -1, 0.0f); // All sound off.
+	} else if (index == 123 && key == -1) {
+		EventDecoderNote(decoder, source, CLAP_EVENT_NOTE_OFF, channel, -1, 0.0f); // All notes off.
+	}
+}
+
+static void EventDecoderMIDI(EventDecoder *decoder, const clap_event_header_t *source, uint8_t status, uint8_t data1, uint8_t data2) {
+	// A MIDI 1.0 channel voice message, from CLAP_EVENT_MIDI or a MIDI 2.0 packet.
+	int16_t channel = status & 0x0F;
+	uint16_t *registeredParameter = &decoder->registeredParameter[channel];
+	data1 &= 0x7F, data2 &= 0x7F;
+
+	if ((status & 0xF0) == 0x90 && data2) {
+		EventDecoderNote(decoder, source, CLAP_EVENT_NOTE_ON, channel, data1, data2 / 127.0f);
+	} else if ((status & 0xF0) == 0x80 || (status & 0xF0) == 0x90) {
+		EventDecoderNote(decoder, source, CLAP_EVENT_NOTE_OFF, channel, data1, data2 / 127.0f);
+	} else if ((status & 0xF0) == 0xE0) {
+		float bend = (((data2 << 7) | data1) - 8192) / 8192.0f;
+		EventDecoderExpression(decoder, source, CLAP_NOTE_EXPRESSION_TUNING, channel, -1, bend * decoder->pitchBendRange[channel]);
+	} else if ((status & 0xF0) == 0xB0) {
+		if (data1 == 101) {
+			*registeredParameter = (*registeredParameter & 0x7F) | (data2 << 7);
+		} else if (data1 == 100) {
+			*registeredParameter = (*registeredParameter & 0x3F80) | data2;
+		} else if (data1 == 6 && *registeredParameter == 0) {
+			decoder->pitchBendRange[channel] = data2;
+		} else if (data1 == 38 && *registeredParameter == 0) {
+			decoder->pitchBendRange[channel] = floorf(decoder->pitchBendRange[channel]) + data2 / 100.0f;
+		} else {
+			// 7-bit values are centred on 64.
+			EventDecoderControl(decoder, source, channel, -1, data1, data2 <= 64 ? data2 / 128.0f : 0.5f + (data2 - 64) / 126.0f);
+		}
+	}
+}
+
+static void EventDecoderMIDI2(EventDecoder *decoder, const clap_event_header_t *source, const uint32_t *words) {
+	// A universal MIDI packet, with the MIDI 1.0 or MIDI 2.0 channel voice messages. 32-bit values are centred on 0x80000000.
+	uint32_t messageType = words[0] >> 28, status = (words[0] >> 20) & 0x0F, index = words[0] & 0xFF;
+	int16_t channel = (words[0] >> 16) & 0x0F, key = (words[0] >> 8) & 0x7F;
+	float value = words[1] / 4294967296.0f;
+
+	if (messageType == 0x2) {
+		EventDecoderMIDI(decoder, source, (words[0] >> 16) & 0xFF, (words[0] >> 8) & 0x7F, words[0] & 0x7F);
+	} else if (messageType != 0x4) {
+		return;
+	} else if (status == 0x9 || status == 0x8) {
+		float velocity = (words[1] >> 16) / 65535.0f;
+		EventDecoderNote(decoder, source, status == 0x9 ? CLAP_EVENT_NOTE_ON : CLAP_EVENT_NOTE_OFF, channel, key, velocity);
+	} else if (status == 0xE || status == 0x6) {
+		// Channel and per-note pitch bend.
+		float bend = (value - 0.5f) * 2.0f * decoder->pitchBendRange[channel];
+		EventDecoderExpression(decoder, source, CLAP_NOTE_EXPRESSION_TUNING, channel, status == 0x6 ? key : -1, bend);
+	} else if (status == 0xB) {
+		EventDecoderControl(decoder, source, channel, -1, key, value);
+	} else if (status == 0x0) {
+		// Registered per-note controllers use the same numbers as the control changes they correspond to.
+		EventDecoderControl(decoder, source, channel, key, index, value);
+	} else if (status == 0x2 && key == 0 && (index & 0x7F) == 0) {
+		// Registered parameter 0, the pitch bend range, in semitones and cents.
+		decoder->pitchBendRange[channel] = (words[1] >> 25) + ((words[1] >> 18) & 0x7F) / 100.0f;
+	}
+}
+
+static void EventDecoderFill(EventDecoder *decoder) {
+	// Reads the next batch of input events in one pass.
+	decoder->count = decoder->position = 0;
+
+	while (decoder->inputPosition < decoder->inputCount && decoder->count < EVENT_BATCH_SIZE) {
+		const clap_event_header_t *event = decoder->input->get(decoder->input, decoder->inputPosition++);
+
+		if (event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_MIDI) {
+			const clap_event_midi_t *midi = (const clap_event_midi_t *) event;
+			EventDecoderMIDI(decoder, event, midi->data[0], midi->data[1], midi->data[2]);
+		} else if (event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_MIDI2) {
+			EventDecoderMIDI2(decoder, event, ((const clap_event_midi2_t *) event)->data);
+		} else if (event->space_id != CLAP_CORE_EVENT_SPACE_ID || event->type != CLAP_EVENT_MIDI_SYSEX) {
+			decoder->events[decoder->count++] = event;
+		}
+	}
+}
+
+static void EventDecoderStart(EventDecoder *decoder, const clap_input_events_t *input) {
+	decoder->input = input;
+	decoder->inputCount = input->size(input);
+	decoder->inputPosition = decoder->count = decoder->position = 0;
+}
+
+static const clap_event_header_t *EventDecoderPeek(EventDecoder *decoder) {
+	// Returns the next event without consuming it, or nullptr after the last one.
+	while (decoder->position == decoder->count && decoder->inputPosition < decoder->inputCount) EventDecoderFill(decoder);
+	return decoder->position < decoder->count ? decoder->events[decoder->position] : nullptr;
+}
+
+static void PluginResetChannels(MyPlugin *plugin) {
+	for (uint32_t i = 0; i < MIDI_CHANNELS; i++) {
+		memcpy(plugin->channelExpressions[i], expressionDefaults, sizeof(expressionDefaults));
+		plugin->eventDecoder.registeredParameter[i] = MIDI_REGISTERED_PARAMETER_NONE;
+		plugin->eventDecoder.pitchBendRange[i] = MIDI_PITCH_BEND_RANGE;
+	}
+}
+
+static uint32_t ExpressionFromID(int32_t expressionID) {
+	// Returns EXPRESSION_COUNT for the expressions the plugin does not use.
+	return expressionID == CLAP_NOTE_EXPRESSION_VOLUME ? EXPRESSION_VOLUME : expressionID == CLAP_NOTE_EXPRESSION_PAN ? EXPRESSION_PAN
+		: expressionID == CLAP_NOTE_EXPRESSION_TUNING ? EXPRESSION_PITCH : expressionID == CLAP_NOTE_EXPRESSION_BRIGHTNESS ? EXPRESSION_BRIGHTNESS : EXPRESSION_COUNT;
+}
+
+static bool PluginExpressionWaiting(MyPlugin *plugin, const clap_event_note_expression_t *event, uint32_t frame) {
+	// Whether a voice the event applies to still has a pending value of the same expression, due before frame.
+	// Pending values that have been made the target are equal to it, so they are not counted.
+	uint32_t expression = ExpressionFromID(event->expression_id);
+	if (expression == EXPRESSION_COUNT) return false;
+	VoicePool *pool = &plugin->voices;
+	uint32_t matchCount = VoicePoolMatch(pool, event->note_id, event->channel, event->key);
+
+	for (uint32_t i = 0; i < matchCount; i++) {
+		uint32_t index = pool->matches[i];
+
+		if (pool->expressionPending[expression][index] != pool->expressionTarget[expression][index] && pool->expressionFrame[expression][index] < frame) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void PluginProcessEvent(MyPlugin *plugin, const clap_event_header_t *event, const clap_output_events_t *out) {
+	if (event->space_id == CLAP_CORE_EVENT_SPACE_ID) {
+		if (event->type == CLAP_EVENT_NOTE_ON || event->type == CLAP_EVENT_NOTE_OFF || event->type == CLAP_EVENT_NOTE_CHOKE) {
+			const clap_event_note_t *noteEvent = (const clap_event_note_t *) event;
+
+			uint32_t matchCount = VoicePoolMatch(&plugin->voices, noteEvent->note_id, noteEvent->channel, noteEvent->key);
+
+			for (uint32_t i = 0; i < matchCount; i++) {
+				uint32_t index = plugin->voices.matches[i];
+
+				if (event->type == CLAP_EVENT_NOTE_CHOKE) {
+					VoicePoolRemove(&plugin->voices, index);
+				} else {
+					plugin->voices.voices[index].held = false;
+					plugin->voices.envelopeStage[index] = ENVELOPE_RELEASE;
+				}
+			}
+
+			if (event->type == CLAP_EVENT_NOTE_ON) {
+				Voice voice = { 
+					.held = true, 
+					.noteID = noteEvent->note_id, 
+					.channel = noteEvent->channel, 
+					.key = noteEvent->key,
+					.age = 0,
+					.velocity = (float) noteEvent->velocity,
+					.parameterOffsets = {},
+				};
+
+				PluginStartVoice(plugin, voice, out);
+			}
+		} else if (event->type == CLAP_EVENT_PARAM_VALUE) {
+			const clap_event_param_value_t *valueEvent = (const clap_event_param_value_t *) event;
+			if (valueEvent->param_id >= P_COUNT) return;
+			uint32_t i = (uint32_t) valueEvent->param_id;
+			PluginApplyParameter(plugin, i, valueEvent->value, event->time);
+
+			// Offline, the GUI is updated once rendering finishes instead.
+			if (!plugin->offline) plugin->audioChanged.Mark(i);
+		} else if (event->type == CLAP_EVENT_PARAM_MOD) {
+			const clap_event_param_mod_t *modEvent = (const clap_event_param_mod_t *) event;
+			if (modEvent->param_id >= P_COUNT) return;
+
+			if (modEvent->note_id == -1 && modEvent->channel == -1 && modEvent->key == -1) {
+				// Modulation that isn't for any note also applies to the voices that start after it.
+				plugin->parameterModulation[modEvent->param_id] = modEvent->amount;
+				return;
+			}
+
+			uint32_t matchCount = VoicePoolMatch(&plugin->voices, modEvent->note_id, modEvent->channel, modEvent->key);
+
+			for (uint32_t i = 0; i < matchCount; i++) {
+				plugin->voices.voices[plugin->voices.matches[i]].parameterOffsets[modEvent->param_id] = modEvent->amount;
+			}
+		} else if (event->type == CLAP_EVENT_NOTE_EXPRESSION) {
+			const clap_event_note_expression_t *expressionEvent = (const clap_event_note_expression_t *) event;
+			uint32_t expression = ExpressionFromID(expressionEvent->expression_id);
+			float value = (float) expressionEvent->value;
+
+			if (expression == EXPRESSION_VOLUME) {
+				value = fminf(fmaxf(value, 0.0f), 4.0f);
+			} else if (expression == EXPRESSION_PAN) {
+				value = FloatClamp01(value);
+			} else if (expression == EXPRESSION_PITCH) {
+				value = exp2f(fminf(fmaxf(value, -EXPRESSION_TUNING_RANGE), EXPRESSION_TUNING_RANGE) / 12.0f);
+			} else if (expression == EXPRESSION_BRIGHTNESS) {
+				value = FloatClamp01(value) * 2.0f - 1.0f;
+			} else {
+				return;
+			}
+
+			if (expressionEvent->note_id == -1 && expressionEvent->key == -1) {
+				// Expressions for whole channels, such as MIDI pitch bend, also apply to the notes that start after them.
+				for (uint32_t i = 0; i < MIDI_CHANNELS; i++) {
+					if (expressionEvent->channel == -1 || expressionEvent->channel == (int16_t) i) plugin->channelExpressions[i][expression] = value;
+				}
+			}
+
+			VoicePool *pool = &plugin->voices;
+			uint32_t matchCount = VoicePoolMatch(pool, expressionEvent->note_id, expressionEvent->channel, expressionEvent->key);
+
+			for (uint32_t i = 0; i < matchCount; i++) {
+				// The block was split if an earlier chunk's value was still pending, so one being replaced here is due in the same chunk.
+				uint32_t index = pool->matches[i];
+				pool->expressionPending[expression][index] = value;
+				pool->expressionFrame[expression][index] = (float) event->time;
+				if (expression == EXPRESSION_PITCH) PluginUpdateVoiceLevel(plugin, index);
+			}
+		}
+	}
+}
+
+template <int kernel>
+static inline SIMDFloat OscillatorSine(SIMDFloat phase) {
+	// Computes sin(2 pi phase) for phase in [0, 1).
+
+	if (kernel == SINE_KERNEL_TABLE) {
+		SIMDFloat position = SIMDMul(phase, SIMDBroadcast(SINE_TABLE_SIZE));
+		SIMDInt index = SIMDTruncate(position);
+		SIMDFloat fraction = SIMDSub(position, SIMDIntToFloat(index));
+		SIMDFloat a = SIMDGather(sineTable, index);
+		SIMDFloat b = SIMDGather(sineTable, SIMDIntAdd(index, SIMDIntBroadcast(1)));
+		return SIMDMulAdd(SIMDSub(b, a), fraction, a);
+	}
+
+	// Shift to x in [-0.5, 0.5), so that sin(2 pi phase) = -sin(2 pi x), then reflect x into [-0.25, 0.25].
+	SIMDFloat x = SIMDSub(phase, SIMDBroadcast(0.5f));
+	x = SIMDSelect(SIMDGreaterThan(x, SIMDBroadcast( 0.25f)), SIMDSub(SIMDBroadcast( 0.5f), x), x);
+	x = SIMDSelect(SIMDLessThan   (x, SIMDBroadcast(-0.25f)), SIMDSub(SIMDBroadcast(-0.5f), x), x);
+	SIMDFloat x2 = SIMDMul(x, x), y;
+
+	if (kernel == SINE_KERNEL_POLYNOMIAL_5) {
+		// Degree 5 minimax polynomial for -sin(2 pi x).
+		y = SIMDBroadcast(-73.58551475f);
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(41.09524269f));
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(-6.281280077f));
+	} else {
+		// Degree 9 minimax polynomial for -sin(2 pi x).
+		y = SIMDBroadcast(-39.53670608f);
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(76.54978230f));
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(-81.60100407f));
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(41.34165503f));
+		y = SIMDMulAdd(y, x2, SIMDBroadcast(-6.283185160f));
+	}
+
+	return SIMDMul(y, x);
+}
+
+static inline SIMDFloat OscillatorWavetable(SIMDFloat phase, const float *table, SIMDInt levelOffset) {
+	// Linearly interpolates each lane's mip level, for phase in [0, 1).
+	SIMDFloat position = SIMDMul(phase, SIMDBroadcast(WAVETABLE_SIZE));
+	SIMDInt index = SIMDTruncate(position);
+	SIMDFloat fraction = SIMDSub(position, SIMDIntToFloat(index));
+	index = SIMDIntAdd(index, levelOffset);
+	SIMDFloat a = SIMDGather(table, index);
+	SIMDFloat b = SIMDGather(table, SIMDIntAdd(index, SIMDIntBroadcast(1)));
+	return SIMDMulAdd(SIMDSub(b, a), fraction, a);
+}
+
+static void SineTableInitialise() {
+	for (uint32_t i = 0; i < SINE_TABLE_SIZE + 2; i++) {
+		sineTable[i] = (float) sin(2.0 * 3.14159265358979 * i / SINE_TABLE_SIZE);
+	}
+}
+
+static float WaveformHarmonic(uint32_t waveform, uint32_t harmonic) {
+	// The amplitude of each harmonic's sine, from the waveform's Fourier series.
+	const float pi = 3.14159265358979f;
+
+	if (waveform == WAVEFORM_SAW) {
+		return (harmonic & 1 ? 2.0f : -2.0f) / (pi * harmonic);
+	} else if (waveform == WAVEFORM_SQUARE) {
+		return harmonic & 1 ? 4.0f / (pi * harmonic) : 0.0f;
+	} else if (waveform == WAVEFORM_TRIANGLE) {
+		return harmonic & 1 ? ((harmonic & 3) == 1 ? 8.0f : -8.0f) / (pi * pi * harmonic * harmonic) : 0.0f;
+	} else {
+		return harmonic == 1 ? 1.0f : 0.0f;
+	}
+}
+
+static void WavetableGenerate(float *levels, const float *harmonics) {
+	// Sums an arbitrary spectrum of up to WAVETABLE_SIZE / 2 harmonic sines (harmonics[0] is the fundamental) into each mip level.
+	// Starting from the last level, each level adds its extra harmonics to a copy of the next, so the whole set costs about as much as level 0.
+	// sin(2 pi h i / WAVETABLE_SIZE) is exactly sineTable[h * i mod WAVETABLE_SIZE].
+	uint32_t harmonicCount = 0;
+
+	for (int32_t level = WAVETABLE_LEVELS - 1; level >= 0; level--) {
+		float *table = levels + level * WAVETABLE_STRIDE;
+		uint32_t levelHarmonics = (WAVETABLE_SIZE / 2) >> level;
+
+		if (level == WAVETABLE_LEVELS - 1) {
+			for (uint32_t i = 0; i < WAVETABLE_SIZE; i++) table[i] = 0.0f;
+		} else {
+			memcpy(table, table + WAVETABLE_STRIDE, WAVETABLE_SIZE * sizeof(float));
+		}
+
+		for (; harmonicCount < levelHarmonics; harmonicCount++) {
+			float amplitude = harmonics[harmonicCount];
+			if (!amplitude) continue;
+			uint32_t harmonic = harmonicCount + 1;
+
+			for (uint32_t i = 0; i < WAVETABLE_SIZE; i++) {
+				table[i] += amplitude * sineTable[(harmonic * i) & (WAVETABLE_SIZE - 1)];
+			}
+		}
+
+		for (uint32_t i = WAVETABLE_SIZE; i < WAVETABLE_STRIDE; i++) {
+			table[i] = table[i - WAVETABLE_SIZE];
+		}
+	}
+}
+
+static const float *WavetablesAcquire() {
+	MutexAcquire(wavetablesMutex);
+
+	if (!wavetablesReferences++) {
+		wavetables = (float *) malloc(WAVEFORM_COUNT * WAVETABLE_LEVELS * WAVETABLE_STRIDE * sizeof(float));
+		float harmonics[WAVETABLE_SIZE / 2];
+
+		for (uint32_t waveform = 0; waveform < WAVEFORM_COUNT; waveform++) {
+			for (uint32_t i = 0; i < WAVETABLE_SIZE / 2; i++) harmonics[i] = WaveformHarmonic(waveform, i + 1);
+			WavetableGenerate(wavetables + waveform * WAVETABLE_LEVELS * WAVETABLE_STRIDE, harmonics);
+		}
+	}
+
+	const float *result = wavetables;
+	MutexRelease(wavetablesMutex);
+	return result;
+}
 
-	void Insert(T newItem, uintptr_t index) {
-		if (length + 1 > allocated) {
-			allocated *= 2;
-			if (length + 1 > allocated) allocated = length + 1;
-			array = (T *) realloc(array, allocated * sizeof(T));
+static void WavetablesRelease() {
+	MutexAcquire(wavetablesMutex);
+
+	if (!--wavetablesReferences) {
+		free(wavetables);
+		wavetables = nullptr;
+	}
+
+	MutexRelease(wavetablesMutex);
+}
+
+// The features a sub-block needs from the voice renderers. Each combination has its own instantiation of the renderers,
+// chosen once per sub-block, so that their inner loops do not branch on features that are not in use.
+#define RENDER_PANNED (1 << 0) // Some voice's pan expression is off centre, so voices without unison are rendered in stereo too.
+#define RENDER_FILTERED (1 << 1) // The filter mode is not FILTER_OFF.
+#define RENDER_VOLUME_MODULATED (1 << 2) // Some voice's volume has a modulation offset, or a route that could give it one.
+#define RENDER_FLAG_COMBINATIONS (8)
+
+struct VoiceRenderInputs {
+	const float *gain; // The smoothed volume parameter for each sample, to which each voice adds its modulation before clamping.
+	EnvelopeCoefficients envelope[2]; // For a whole chunk, and for the shorter last one.
+	const float *wavetable; // The levels of the waveform, for OSCILLATOR_WAVETABLE.
+	uint32_t unisonCount; // The number of sub-oscillators used by each voice, for PluginRenderUnisonGroup.
+	uint32_t filterMode;
+	const float *cutoff; // The smoothed cutoff parameter for each sample.
+	const float *filterTable;
+	float filterDamping; // 1 / Q.
+	float filterMix[3]; // The weights of the input, band-pass and low-pass outputs that make up the filter mode's response.
+	float modulation[MODULATION_DESTINATION_COUNT][MODULATION_SOURCE_COUNT]; // The amount of each route, in its destination's units.
+	float lfoIncrement; // The LFO's phase increment per frame.
+	float expressionCoefficient[2]; // The expressions' one-pole coefficient for a whole chunk, and for the shorter last one.
+	uint32_t firstFrame; // The sub-block's start in the block, which the frames of pending expressions are relative to.
+	uint32_t flags; // RENDER_PANNED, RENDER_FILTERED and RENDER_VOLUME_MODULATED, from PluginRenderFlags.
+};
+
+static inline void ModulationEvaluate(const VoiceRenderInputs *inputs, const SIMDFloat *sources, SIMDFloat *destinations) {
+	// A matrix-vector product for each lane's voice. The destinations start with the host's modulation.
+	for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) {
+		for (uint32_t j = 0; j < MODULATION_SOURCE_COUNT; j++) {
+			destinations[i] = SIMDMulAdd(sources[j], SIMDBroadcast(inputs->modulation[i][j]), destinations[i]);
+		}
+	}
+}
+
+static inline SIMDFloat ModulationAdvanceLFO(SIMDFloat *phase, SIMDFloat increment) {
+	*phase = SIMDAdd(*phase, increment);
+	*phase = SIMDSub(*phase, SIMDFloor(*phase));
+	return OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(*phase);
+}
+
+static inline SIMDFloat ExpressionAdvance(VoicePool *pool, uint32_t expression, uintptr_t first, SIMDFloat chunkEnd, SIMDFloat coefficient) {
+	// Moves the expression of the vector of voices starting at first towards its target, for one chunk, and returns the new value.
+	// A pending value becomes the target in the chunk that contains its event.
+	float *value = pool->expression[expression] + first, *target = pool->expressionTarget[expression] + first;
+	SIMDMask due = SIMDLessThan(SIMDLoad(pool->expressionFrame[expression] + first), chunkEnd);
+	SIMDFloat nextTarget = SIMDSelect(due, SIMDLoad(pool->expressionPending[expression] + first), SIMDLoad(target));
+	SIMDFloat previous = SIMDLoad(value);
+	SIMDFloat next = SIMDMulAdd(SIMDSub(nextTarget, previous), coefficient, previous);
+	SIMDStore(target, nextTarget);
+	SIMDStore(value, next);
+	return next;
+}
+
+static inline void ExpressionPanGains(SIMDFloat pan, SIMDFloat *gainL, SIMDFloat *gainR) {
+	// Constant power, with unity gain in the centre: sqrt(2) cos(pi pan / 2) and sqrt(2) sin(pi pan / 2).
+	SIMDFloat angle = SIMDMul(pan, SIMDBroadcast(0.25f)), root2 = SIMDBroadcast(1.41421356f);
+	*gainL = SIMDMul(OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(SIMDAdd(angle, SIMDBroadcast(0.25f))), root2);
+	*gainR = SIMDMul(OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(angle), root2);
+}
+
+static inline SIMDFloat FilterTableLookup(const float *table, SIMDFloat cutoff) {
+	// The vector version of FilterTableRead.
+	SIMDFloat position = SIMDMul(SIMDMin(SIMDMax(cutoff, SIMDBroadcast(0.0f)), SIMDBroadcast(1.0f)), SIMDBroadcast(FILTER_TABLE_SIZE));
+	SIMDInt index = SIMDTruncate(position);
+	SIMDFloat fraction = SIMDSub(position, SIMDIntToFloat(index));
+	SIMDFloat a = SIMDGather(table, index);
+	SIMDFloat b = SIMDGather(table, SIMDIntAdd(index, SIMDIntBroadcast(1)));
+	return SIMDMulAdd(SIMDSub(b, a), fraction, a);
+}
+
+struct FilterCoefficients {
+	SIMDFloat a1, a2, a3;
+};
+
+static inline FilterCoefficients FilterCoefficientsFromTan(SIMDFloat g, const VoiceRenderInputs *inputs) {
+	// The coefficients for g, the tan of the cutoff read from the table. Computed at the ends of each chunk, and interpolated between them.
+	FilterCoefficients c;
+	c.a1 = SIMDDiv(SIMDBroadcast(1.0f), SIMDMulAdd(g, SIMDAdd(g, SIMDBroadcast(inputs->filterDamping)), SIMDBroadcast(1.0f)));
+	c.a2 = SIMDMul(g, c.a1);
+	c.a3 = SIMDMul(g, c.a2);
+	return c;
+}
+
+static inline void FilterCoefficientsStep(FilterCoefficients *c, FilterCoefficients *step, SIMDFloat g0, SIMDFloat g1, SIMDFloat chunkReciprocal, 
+		const VoiceRenderInputs *inputs) {
+	// Sets c to the coefficients at the start of a chunk, and step to their increment per sample, so that they reach g1's coefficients at its end.
+	FilterCoefficients end = FilterCoefficientsFromTan(g1, inputs);
+	*c = FilterCoefficientsFromTan(g0, inputs);
+	step->a1 = SIMDMul(SIMDSub(end.a1, c->a1), chunkReciprocal);
+	step->a2 = SIMDMul(SIMDSub(end.a2, c->a2), chunkReciprocal);
+	step->a3 = SIMDMul(SIMDSub(end.a3, c->a3), chunkReciprocal);
+}
+
+static inline void FilterCoefficientsAdvance(FilterCoefficients *c, const FilterCoefficients *step) {
+	c->a1 = SIMDAdd(c->a1, step->a1);
+	c->a2 = SIMDAdd(c->a2, step->a2);
+	c->a3 = SIMDAdd(c->a3, step->a3);
+}
+
+static inline SIMDFloat FilterProcess(SIMDFloat input, const FilterCoefficients *c, SIMDFloat *state1, SIMDFloat *state2, const VoiceRenderInputs *inputs) {
+	// One sample of a topology-preserving transform state-variable filter, for each lane.
+	// No part of the coefficient calculation is done per sample: tan is read from the table, and the division done, at the ends of each chunk.
+	SIMDFloat two = SIMDBroadcast(2.0f);
+	SIMDFloat v3 = SIMDSub(input, *state2);
+	SIMDFloat v1 = SIMDMulAdd(c->a1, *state1, SIMDMul(c->a2, v3));
+	SIMDFloat v2 = SIMDAdd(*state2, SIMDMulAdd(c->a2, *state1, SIMDMul(c->a3, v3)));
+	*state1 = SIMDSub(SIMDMul(two, v1), *state1);
+	*state2 = SIMDSub(SIMDMul(two, v2), *state2);
+	SIMDFloat output = SIMDMul(input, SIMDBroadcast(inputs->filterMix[0]));
+	output = SIMDMulAdd(v1, SIMDBroadcast(inputs->filterMix[1]), output);
+	return SIMDMulAdd(v2, SIMDBroadcast(inputs->filterMix[2]), output);
+}
+
+template <int oscillator, uint32_t flags>
+static void PluginRenderVoiceGroup(VoicePool *pool, uint32_t first, const VoiceRenderInputs *inputs, float *outputL, float *outputR, uint32_t frameCount) {
+	// Renders the VOICE_GROUP_SIZE voices starting at first, one per lane, adding their sum into the output.
+	// The oscillator is a sine kernel, or OSCILLATOR_WAVETABLE. The envelopes are advanced at the start of each chunk.
+	// The phase update is a loop-carried dependency, so several vectors are interleaved to hide its latency.
+	// Unless panned, the voices are mono, and only outputL is written.
+	const bool panned = flags & RENDER_PANNED, filtered = flags & RENDER_FILTERED, volumeModulated = flags & RENDER_VOLUME_MODULATED;
+	SIMDFloat phase[VOICE_GROUP_VECTORS], increment[VOICE_GROUP_VECTORS], volume[VOICE_GROUP_VECTORS], volumeOffset[VOICE_GROUP_VECTORS];
+	SIMDFloat envelopeLevel[VOICE_GROUP_VECTORS], envelopeStage[VOICE_GROUP_VECTORS];
+	SIMDFloat filterCoefficient[VOICE_GROUP_VECTORS], filterState1[VOICE_GROUP_VECTORS], filterState2[VOICE_GROUP_VECTORS];
+	SIMDFloat lfoPhase[VOICE_GROUP_VECTORS];
+	SIMDInt wavetableOffset[VOICE_GROUP_VECTORS];
+
+	for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+		phase[j] = SIMDLoad(pool->phase + first + j * SIMD_WIDTH);
+		increment[j] = SIMDLoad(pool->increment + first + j * SIMD_WIDTH);
+		volume[j] = SIMDLoad(pool->volume + first + j * SIMD_WIDTH);
+		volumeOffset[j] = SIMDLoad(pool->volumeOffset + first + j * SIMD_WIDTH);
+		lfoPhase[j] = SIMDLoad(pool->lfoPhase + first + j * SIMD_WIDTH);
+		envelopeLevel[j] = SIMDLoad(pool->envelopeLevel + first + j * SIMD_WIDTH);
+		envelopeStage[j] = SIMDLoad(pool->envelopeStage + first + j * SIMD_WIDTH);
+		wavetableOffset[j] = SIMDTruncate(SIMDLoad(pool->wavetableOffset + first + j * SIMD_WIDTH));
+		filterCoefficient[j] = SIMDLoad(pool->filterCoefficient + first + j * SIMD_WIDTH);
+		filterState1[j] = SIMDLoad(pool->filterState1 + first + j * SIMD_WIDTH);
+		filterState2[j] = SIMDLoad(pool->filterState2 + first + j * SIMD_WIDTH);
+	}
+
+	for (uint32_t chunkStart = 0; chunkStart < frameCount; chunkStart += ENVELOPE_CHUNK) {
+		uint32_t chunkEnd = frameCount - chunkStart < ENVELOPE_CHUNK ? frameCount : chunkStart + ENVELOPE_CHUNK;
+		const EnvelopeCoefficients *coefficients = &inputs->envelope[chunkEnd - chunkStart == ENVELOPE_CHUNK ? 0 : 1];
+		SIMDFloat chunkReciprocal = SIMDBroadcast(1.0f / (chunkEnd - chunkStart));
+		SIMDFloat lfoIncrement = SIMDBroadcast(inputs->lfoIncrement * (chunkEnd - chunkStart));
+		SIMDFloat expressionEnd = SIMDBroadcast((float) (inputs->firstFrame + chunkEnd));
+		SIMDFloat expressionCoefficient = SIMDBroadcast(inputs->expressionCoefficient[chunkEnd - chunkStart == ENVELOPE_CHUNK ? 0 : 1]);
+		SIMDFloat amplitude[VOICE_GROUP_VECTORS], amplitudeStep[VOICE_GROUP_VECTORS];
+		FilterCoefficients filter[VOICE_GROUP_VECTORS], filterStep[VOICE_GROUP_VECTORS];
+		SIMDFloat volumeOffsetStep[VOICE_GROUP_VECTORS], volumeOffsetTarget[VOICE_GROUP_VECTORS];
+		SIMDFloat chunkIncrement[VOICE_GROUP_VECTORS], panL[VOICE_GROUP_VECTORS], panR[VOICE_GROUP_VECTORS];
+
+		for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+			// The voice's volume and volume expression are folded into its envelope for the chunk, and its pitch expression into its increment.
+			SIMDFloat previousExpressionVolume = SIMDLoad(pool->expression[EXPRESSION_VOLUME] + first + j * SIMD_WIDTH);
+			SIMDFloat expressionVolume = ExpressionAdvance(pool, EXPRESSION_VOLUME, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient);
+			SIMDFloat previousLevel = SIMDMul(EnvelopeAdvance(&envelopeLevel[j], &envelopeStage[j], coefficients), previousExpressionVolume);
+			amplitude[j] = SIMDMul(previousLevel, volume[j]);
+			amplitudeStep[j] = SIMDMul(SIMDSub(SIMDMul(envelopeLevel[j], expressionVolume), previousLevel), SIMDMul(volume[j], chunkReciprocal));
+			chunkIncrement[j] = SIMDMul(increment[j], ExpressionAdvance(pool, EXPRESSION_PITCH, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient));
+			chunkIncrement[j] = SIMDMin(chunkIncrement[j], SIMDBroadcast(EXPRESSION_MAXIMUM_INCREMENT));
+			if (panned) ExpressionPanGains(ExpressionAdvance(pool, EXPRESSION_PAN, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient), &panL[j], &panR[j]);
+
+			// The modulation at the end of the chunk.
+			SIMDFloat sources[MODULATION_SOURCE_COUNT], offsets[MODULATION_DESTINATION_COUNT];
+			sources[MODULATION_SOURCE_ENVELOPE] = envelopeLevel[j];
+			sources[MODULATION_SOURCE_LFO] = ModulationAdvanceLFO(&lfoPhase[j], lfoIncrement);
+			sources[MODULATION_SOURCE_VELOCITY] = SIMDSub(SIMDLoad(pool->velocity + first + j * SIMD_WIDTH), SIMDBroadcast(1.0f));
+			sources[MODULATION_SOURCE_BRIGHTNESS] = ExpressionAdvance(pool, EXPRESSION_BRIGHTNESS, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient);
+			for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) offsets[i] = SIMDLoad(pool->hostModulation[i] + first + j * SIMD_WIDTH);
+			ModulationEvaluate(inputs, sources, offsets);
+			volumeOffsetTarget[j] = offsets[MODULATION_DESTINATION_VOLUME];
+			volumeOffsetStep[j] = SIMDMul(SIMDSub(volumeOffsetTarget[j], volumeOffset[j]), chunkReciprocal);
+
+			if (filtered) {
+				SIMDFloat cutoff = SIMDAdd(offsets[MODULATION_DESTINATION_CUTOFF], SIMDBroadcast(inputs->cutoff[chunkEnd - 1]));
+				SIMDFloat nextCoefficient = FilterTableLookup(inputs->filterTable, cutoff);
+				FilterCoefficientsStep(&filter[j], &filterStep[j], filterCoefficient[j], nextCoefficient, chunkReciprocal, inputs);
+				filterCoefficient[j] = nextCoefficient;
+			}
+		}
+
+		for (uint32_t index = chunkStart; index < chunkEnd; index++) {
+			SIMDFloat sampleGain = SIMDBroadcast(inputs->gain[index]);
+			SIMDFloat sumL = SIMDBroadcast(0.0f), sumR = SIMDBroadcast(0.0f);
+
+			for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+				// Without volume modulation the offset is zero, and the volume parameter needs no clamping.
+				SIMDFloat voiceGain = sampleGain;
+
+				if (volumeModulated) {
+					volumeOffset[j] = SIMDAdd(volumeOffset[j], volumeOffsetStep[j]);
+					voiceGain = SIMDMin(SIMDMax(SIMDAdd(sampleGain, volumeOffset[j]), SIMDBroadcast(0.0f)), SIMDBroadcast(1.0f));
+				}
+
+				SIMDFloat wave = oscillator == OSCILLATOR_WAVETABLE ? OscillatorWavetable(phase[j], inputs->wavetable, wavetableOffset[j]) 
+					: OscillatorSine<oscillator>(phase[j]);
+
+				if (filtered) {
+					FilterCoefficientsAdvance(&filter[j], &filterStep[j]);
+					wave = FilterProcess(wave, &filter[j], &filterState1[j], &filterState2[j], inputs);
+				}
+
+				SIMDFloat gain = SIMDMul(voiceGain, amplitude[j]);
+				amplitude[j] = SIMDAdd(amplitude[j], amplitudeStep[j]);
+
+				if (panned) {
+					sumL = SIMDMulAdd(wave, SIMDMul(gain, panL[j]), sumL);
+					sumR = SIMDMulAdd(wave, SIMDMul(gain, panR[j]), sumR);
+				} else {
+					sumL = SIMDMulAdd(wave, gain, sumL);
+				}
+			}
+
+			outputL[index] += SIMDSum(sumL);
+			if (panned) outputR[index] += SIMDSum(sumR);
+
+			for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+				// The increment is clamped to at most EXPRESSION_MAXIMUM_INCREMENT, 0.49, so the phase stays below 2, and this is equivalent to subtracting its floor, with a shorter latency.
+				phase[j] = SIMDAdd(phase[j], chunkIncrement[j]);
+				phase[j] = SIMDSub(phase[j], SIMDSelect(SIMDLessThan(phase[j], SIMDBroadcast(1.0f)), SIMDBroadcast(0.0f), SIMDBroadcast(1.0f)));
+			}
+		}
+
+		for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+			// Finish the chunk on the exact offset, so that it settles back to zero once the modulation stops.
+			if (volumeModulated) volumeOffset[j] = volumeOffsetTarget[j];
+		}
+	}
+
+	for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+		SIMDStore(pool->phase + first + j * SIMD_WIDTH, phase[j]);
+		SIMDStore(pool->envelopeLevel + first + j * SIMD_WIDTH, envelopeLevel[j]);
+		SIMDStore(pool->envelopeStage + first + j * SIMD_WIDTH, envelopeStage[j]);
+		SIMDStore(pool->filterCoefficient + first + j * SIMD_WIDTH, filterCoefficient[j]);
+		SIMDStore(pool->filterState1 + first + j * SIMD_WIDTH, filterState1[j]);
+		SIMDStore(pool->filterState2 + first + j * SIMD_WIDTH, filterState2[j]);
+		SIMDStore(pool->volumeOffset + first + j * SIMD_WIDTH, volumeOffset[j]);
+		SIMDStore(pool->lfoPhase + first + j * SIMD_WIDTH, lfoPhase[j]);
+	}
+}
+
+template <int oscillator, uint32_t flags>
+static void PluginRenderUnisonGroup(VoicePool *pool, uint32_t first, const VoiceRenderInputs *inputs, float *outputL, float *outputR, uint32_t frameCount) {
+	// Renders the voices in the group starting at first, each with inputs->unisonCount sub-oscillators, adding them into the stereo output.
+	// Each voice's sub-oscillators take one or more vectors. Within a chunk, their phases are computed from the phase at the start of the chunk,
+	// so there is no loop-carried dependency even when a voice only has one vector.
+	const bool panned = flags & RENDER_PANNED, filtered = flags & RENDER_FILTERED, volumeModulated = flags & RENDER_VOLUME_MODULATED;
+	uint32_t vectorCount = (inputs->unisonCount + SIMD_WIDTH - 1) / SIMD_WIDTH;
+	uint32_t voiceCount = pool->count - first < VOICE_GROUP_SIZE ? pool->count - first : VOICE_GROUP_SIZE;
+	SIMDFloat envelopeLevel[VOICE_GROUP_VECTORS], envelopeStage[VOICE_GROUP_VECTORS], lfoPhase[VOICE_GROUP_VECTORS];
+	float amplitude[VOICE_GROUP_SIZE], amplitudeStep[VOICE_GROUP_SIZE];
+	float filterA1[VOICE_GROUP_SIZE], filterA2[VOICE_GROUP_SIZE], filterA3[VOICE_GROUP_SIZE];
+	float filterStepA1[VOICE_GROUP_SIZE], filterStepA2[VOICE_GROUP_SIZE], filterStepA3[VOICE_GROUP_SIZE];
+	float volumeOffset[VOICE_GROUP_SIZE], volumeOffsetStep[VOICE_GROUP_SIZE];
+	float pitch[VOICE_GROUP_SIZE], panGainL[VOICE_GROUP_SIZE], panGainR[VOICE_GROUP_SIZE];
+
+	for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+		envelopeLevel[j] = SIMDLoad(pool->envelopeLevel + first + j * SIMD_WIDTH);
+		envelopeStage[j] = SIMDLoad(pool->envelopeStage + first + j * SIMD_WIDTH);
+		lfoPhase[j] = SIMDLoad(pool->lfoPhase + first + j * SIMD_WIDTH);
+	}
+
+	for (uint32_t chunkStart = 0; chunkStart < frameCount; chunkStart += ENVELOPE_CHUNK) {
+		uint32_t chunkLength = frameCount - chunkStart < ENVELOPE_CHUNK ? frameCount - chunkStart : ENVELOPE_CHUNK;
+		const EnvelopeCoefficients *coefficients = &inputs->envelope[chunkLength == ENVELOPE_CHUNK ? 0 : 1];
+		SIMDFloat chunkReciprocal = SIMDBroadcast(1.0f / chunkLength);
+		SIMDFloat lfoIncrement = SIMDBroadcast(inputs->lfoIncrement * chunkLength);
+		SIMDFloat expressionEnd = SIMDBroadcast((float) (inputs->firstFrame + chunkStart + chunkLength));
+		SIMDFloat expressionCoefficient = SIMDBroadcast(inputs->expressionCoefficient[chunkLength == ENVELOPE_CHUNK ? 0 : 1]);
+
+		for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+			// The envelopes, expressions and modulation are advanced together, and then applied to each voice in turn.
+			SIMDFloat volume = SIMDLoad(pool->volume + first + j * SIMD_WIDTH);
+			SIMDFloat previousExpressionVolume = SIMDLoad(pool->expression[EXPRESSION_VOLUME] + first + j * SIMD_WIDTH);
+			SIMDFloat expressionVolume = ExpressionAdvance(pool, EXPRESSION_VOLUME, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient);
+			SIMDFloat previousLevel = SIMDMul(EnvelopeAdvance(&envelopeLevel[j], &envelopeStage[j], coefficients), previousExpressionVolume);
+			SIMDStore(amplitude + j * SIMD_WIDTH, SIMDMul(previousLevel, volume));
+			SIMDStore(amplitudeStep + j * SIMD_WIDTH, SIMDMul(SIMDSub(SIMDMul(envelopeLevel[j], expressionVolume), previousLevel), SIMDMul(volume, chunkReciprocal)));
+			SIMDStore(pitch + j * SIMD_WIDTH, ExpressionAdvance(pool, EXPRESSION_PITCH, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient));
+
+			if (panned) {
+				SIMDFloat gainL, gainR;
+				ExpressionPanGains(ExpressionAdvance(pool, EXPRESSION_PAN, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient), &gainL, &gainR);
+				SIMDStore(panGainL + j * SIMD_WIDTH, gainL);
+				SIMDStore(panGainR + j * SIMD_WIDTH, gainR);
+			}
+
+			SIMDFloat sources[MODULATION_SOURCE_COUNT], offsets[MODULATION_DESTINATION_COUNT];
+			sources[MODULATION_SOURCE_ENVELOPE] = envelopeLevel[j];
+			sources[MODULATION_SOURCE_LFO] = ModulationAdvanceLFO(&lfoPhase[j], lfoIncrement);
+			sources[MODULATION_SOURCE_VELOCITY] = SIMDSub(SIMDLoad(pool->velocity + first + j * SIMD_WIDTH), SIMDBroadcast(1.0f));
+			sources[MODULATION_SOURCE_BRIGHTNESS] = ExpressionAdvance(pool, EXPRESSION_BRIGHTNESS, first + j * SIMD_WIDTH, expressionEnd, expressionCoefficient);
+			for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) offsets[i] = SIMDLoad(pool->hostModulation[i] + first + j * SIMD_WIDTH);
+			ModulationEvaluate(inputs, sources, offsets);
+			SIMDFloat previousVolumeOffset = SIMDLoad(pool->volumeOffset + first + j * SIMD_WIDTH);
+			SIMDStore(volumeOffset + j * SIMD_WIDTH, previousVolumeOffset);
+			SIMDStore(volumeOffsetStep + j * SIMD_WIDTH, SIMDMul(SIMDSub(offsets[MODULATION_DESTINATION_VOLUME], previousVolumeOffset), chunkReciprocal));
+			SIMDStore(pool->volumeOffset + first + j * SIMD_WIDTH, offsets[MODULATION_DESTINATION_VOLUME]);
+
+			if (filtered) {
+				SIMDFloat cutoff = SIMDAdd(offsets[MODULATION_DESTINATION_CUTOFF], SIMDBroadcast(inputs->cutoff[chunkStart + chunkLength - 1]));
+				SIMDFloat previousCoefficient = SIMDLoad(pool->filterCoefficient + first + j * SIMD_WIDTH);
+				SIMDFloat nextCoefficient = FilterTableLookup(inputs->filterTable, cutoff);
+				FilterCoefficients filter, filterStep;
+				FilterCoefficientsStep(&filter, &filterStep, previousCoefficient, nextCoefficient, chunkReciprocal, inputs);
+				SIMDStore(filterA1 + j * SIMD_WIDTH, filter.a1);
+				SIMDStore(filterA2 + j * SIMD_WIDTH, filter.a2);
+				SIMDStore(filterA3 + j * SIMD_WIDTH, filter.a3);
+				SIMDStore(filterStepA1 + j * SIMD_WIDTH, filterStep.a1);
+				SIMDStore(filterStepA2 + j * SIMD_WIDTH, filterStep.a2);
+				SIMDStore(filterStepA3 + j * SIMD_WIDTH, filterStep.a3);
+				SIMDStore(pool->filterCoefficient + first + j * SIMD_WIDTH, nextCoefficient);
+			}
+		}
+
+		SIMDFloat sumL[ENVELOPE_CHUNK], sumR[ENVELOPE_CHUNK];
+
+		for (uint32_t index = 0; index < chunkLength; index++) {
+			sumL[index] = sumR[index] = SIMDBroadcast(0.0f);
+		}
+
+		for (uint32_t voice = 0; voice < voiceCount; voice++) {
+			SIMDFloat sampleAmplitude[ENVELOPE_CHUNK];
+			FilterCoefficients sampleFilter[ENVELOPE_CHUNK];
+			SIMDInt wavetableOffset = SIMDIntBroadcast((int32_t) pool->wavetableOffset[first + voice]);
+
+			for (uint32_t index = 0; index < chunkLength; index++) {
+				float voiceGain = inputs->gain[chunkStart + index];
+				if (volumeModulated) voiceGain = FloatClamp01(voiceGain + volumeOffset[voice] + volumeOffsetStep[voice] * (index + 1));
+				sampleAmplitude[index] = SIMDBroadcast(voiceGain * (amplitude[voice] + amplitudeStep[voice] * index));
+
+				if (filtered) {
+					sampleFilter[index].a1 = SIMDBroadcast(filterA1[voice] + filterStepA1[voice] * (index + 1));
+					sampleFilter[index].a2 = SIMDBroadcast(filterA2[voice] + filterStepA2[voice] * (index + 1));
+					sampleFilter[index].a3 = SIMDBroadcast(filterA3[voice] + filterStepA3[voice] * (index + 1));
+				}
+			}
+
+			for (uint32_t j = 0; j < vectorCount; j++) {
+				uintptr_t offset = (first + voice) * UNISON_MAXIMUM + j * SIMD_WIDTH;
+				SIMDFloat phase = SIMDLoad(pool->unisonPhase + offset);
+				SIMDFloat increment = SIMDMul(SIMDLoad(pool->unisonIncrement + offset), SIMDBroadcast(pitch[voice]));
+				increment = SIMDMin(increment, SIMDBroadcast(EXPRESSION_MAXIMUM_INCREMENT));
+				SIMDFloat panL = SIMDLoad(pool->unisonPanL + offset);
+				SIMDFloat panR = SIMDLoad(pool->unisonPanR + offset);
+
+				if (panned) {
+					panL = SIMDMul(panL, SIMDBroadcast(panGainL[voice]));
+					panR = SIMDMul(panR, SIMDBroadcast(panGainR[voice]));
+				}
+				SIMDFloat filterState1 = SIMDLoad(pool->unisonFilterState1 + offset);
+				SIMDFloat filterState2 = SIMDLoad(pool->unisonFilterState2 + offset);
+
+				for (uint32_t index = 0; index < chunkLength; index++) {
+					SIMDFloat samplePhase = SIMDMulAdd(SIMDBroadcast((float) index), increment, phase);
+					samplePhase = SIMDSub(samplePhase, SIMDFloor(samplePhase));
+					SIMDFloat wave = oscillator == OSCILLATOR_WAVETABLE ? OscillatorWavetable(samplePhase, inputs->wavetable, wavetableOffset) 
+						: OscillatorSine<oscillator>(samplePhase);
+
+					if (filtered) {
+						wave = FilterProcess(wave, &sampleFilter[index], &filterState1, &filterState2, inputs);
+					}
+
+					wave = SIMDMul(wave, sampleAmplitude[index]);
+					sumL[index] = SIMDMulAdd(wave, panL, sumL[index]);
+					sumR[index] = SIMDMulAdd(wave, panR, sumR[index]);
+				}
+
+				phase = SIMDMulAdd(SIMDBroadcast((float) chunkLength), increment, phase);
+				SIMDStore(pool->unisonPhase + offset, SIMDSub(phase, SIMDFloor(phase)));
+				SIMDStore(pool->unisonFilterState1 + offset, filterState1);
+				SIMDStore(pool->unisonFilterState2 + offset, filterState2);
+			}
 		}
 
-		length++;
-		memmove(array + index + 1, array + index, (length - index - 1) * sizeof(T));
-		array[index] = newItem;
+		for (uint32_t index = 0; index < chunkLength; index++) {
+			outputL[chunkStart + index] += SIMDSum(sumL[index]);
+			outputR[chunkStart + index] += SIMDSum(sumR[index]);
+		}
 	}
 
-	void Delete(uintptr_t index) { 
-		memmove(array + index, array + index + 1, (length - index - 1) * sizeof(T)); 
-		length--;
+	for (uint32_t j = 0; j < VOICE_GROUP_VECTORS; j++) {
+		SIMDStore(pool->envelopeLevel + first + j * SIMD_WIDTH, envelopeLevel[j]);
+		SIMDStore(pool->envelopeStage + first + j * SIMD_WIDTH, envelopeStage[j]);
+		SIMDStore(pool->lfoPhase + first + j * SIMD_WIDTH, lfoPhase[j]);
 	}
+}
 
-	void Add(T item) { Insert(item, length); }
-	void Free() { free(array); array = nullptr; length = allocated = 0; }
-	int Length() { return length; }
-	T &operator[](uintptr_t index) { assert(index < length); return array[index]; }
+typedef void (*VoiceGroupRenderer)(VoicePool *pool, uint32_t first, const VoiceRenderInputs *inputs, float *outputL, float *outputR, uint32_t frameCount);
+
+#define RENDERER_VARIANTS(renderer, oscillator) { \
+	renderer<oscillator, 0>, renderer<oscillator, 1>, renderer<oscillator, 2>, renderer<oscillator, 3>, \
+	renderer<oscillator, 4>, renderer<oscillator, 5>, renderer<oscillator, 6>, renderer<oscillator, 7>, }
+
+static_assert(RENDER_FLAG_COMBINATIONS == 8, "RENDERER_VARIANTS instantiates each combination of the flags.");
+
+static const VoiceGroupRenderer voiceGroupRenderers[SINE_KERNEL_COUNT + 1][RENDER_FLAG_COMBINATIONS] = {
+	RENDERER_VARIANTS(PluginRenderVoiceGroup, SINE_KERNEL_POLYNOMIAL_5),
+	RENDERER_VARIANTS(PluginRenderVoiceGroup, SINE_KERNEL_POLYNOMIAL_9),
+	RENDERER_VARIANTS(PluginRenderVoiceGroup, SINE_KERNEL_TABLE),
+	RENDERER_VARIANTS(PluginRenderVoiceGroup, OSCILLATOR_WAVETABLE),
+};
+
+static const VoiceGroupRenderer unisonGroupRenderers[SINE_KERNEL_COUNT + 1][RENDER_FLAG_COMBINATIONS] = {
+	RENDERER_VARIANTS(PluginRenderUnisonGroup, SINE_KERNEL_POLYNOMIAL_5),
+	RENDERER_VARIANTS(PluginRenderUnisonGroup, SINE_KERNEL_POLYNOMIAL_9),
+	RENDERER_VARIANTS(PluginRenderUnisonGroup, SINE_KERNEL_TABLE),
+	RENDERER_VARIANTS(PluginRenderUnisonGroup, OSCILLATOR_WAVETABLE),
 };
 
-#ifdef _WIN32
-#include <windows.h>
-typedef HANDLE Mutex;
-#define MutexAcquire(mutex) WaitForSingleObject(mutex, INFINITE)
-#define MutexRelease(mutex) ReleaseMutex(mutex)
-#define MutexInitialise(mutex) (mutex = CreateMutex(nullptr, FALSE, nullptr))
-#define MutexDestroy(mutex) CloseHandle(mutex)
-#else
-#include <pthread.h>
-typedef pthread_mutex_t Mutex;
-#define MutexAcquire(mutex) pthread_mutex_lock(&(mutex))
-#define MutexRelease(mutex) pthread_mutex_unlock(&(mutex))
-#define MutexInitialise(mutex) pthread_mutex_init(&(mutex), nullptr)
-#define MutexDestroy(mutex) pthread_mutex_destroy(&(mutex))
-#endif
+static void PluginRenderVoices(VoicePool *pool, const VoiceRenderInputs *inputs, uint32_t oscillator, uint32_t first, uint32_t last, 
+		float *outputL, float *outputR, uint32_t frameCount) {
+	// Adds the voices from first up to last to the outputs. Without unison or panning the voices are mono, and only outputL is written.
+	// Unused lanes in the last group have a volume of zero.
+	VoiceGroupRenderer renderer = (inputs->unisonCount > 1 ? unisonGroupRenderers : voiceGroupRenderers)[oscillator][inputs->flags];
+
+	for (uint32_t i = first; i < last; i += VOICE_GROUP_SIZE) {
+		renderer(pool, i, inputs, outputL, outputR, frameCount);
+	}
+}
+
+static void PluginRenderTask(MyPlugin *plugin, uint32_t task) {
+	// Renders one task's voices into its scratch buffers, on whichever thread the host runs it.
+	// The voice groups of different tasks do not overlap, so tasks only write to their own voices' state.
+	float *scratchL = plugin->renderScratch + task * 2 * plugin->maximumFrameCount, *scratchR = scratchL + plugin->maximumFrameCount;
+	uint32_t first = task * RENDER_TASK_VOICES, last = first + RENDER_TASK_VOICES;
+	if (last > plugin->voices.count) last = plugin->voices.count;
+	memset(scratchL, 0, plugin->renderFrameCount * sizeof(float));
+	if (plugin->renderInputs->unisonCount > 1 || (plugin->renderInputs->flags & RENDER_PANNED)) memset(scratchR, 0, plugin->renderFrameCount * sizeof(float));
+	PluginRenderVoices(&plugin->voices, plugin->renderInputs, plugin->renderOscillator, first, last, scratchL, scratchR, plugin->renderFrameCount);
+}
+
+static void PluginRenderWorkersRunTasks(MyPlugin *plugin) {
+	RenderWorkers *workers = &plugin->renderWorkers;
+	uint32_t task;
+
+	while ((task = workers->nextTask.fetch_add(1, std::memory_order_relaxed)) < workers->taskCount) {
+		PluginRenderTask(plugin, task);
+	}
+}
+
+static void *PluginRenderWorker(void *argument) {
+	MyPlugin *plugin = (MyPlugin *) argument;
+
+	while (true) {
+		SemaphoreWait(plugin->renderWorkers.start);
+		if (plugin->renderWorkers.quit.load(std::memory_order_acquire)) break;
+		PluginRenderWorkersRunTasks(plugin);
+		SemaphorePost(plugin->renderWorkers.done);
+	}
+
+	return nullptr;
+}
+
+static void PluginRenderWorkersExec(MyPlugin *plugin, uint32_t taskCount) {
+	// On the audio thread. Wakes the workers, takes tasks alongside them, and waits for them all to finish.
+	RenderWorkers *workers = &plugin->renderWorkers;
+	workers->taskCount = taskCount;
+	workers->nextTask.store(0, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < RENDER_TASK_COUNT - 1; i++) SemaphorePost(workers->start);
+	PluginRenderWorkersRunTasks(plugin);
+	for (uint32_t i = 0; i < RENDER_TASK_COUNT - 1; i++) SemaphoreWait(workers->done);
+}
+
+static void PluginRenderWorkersStart(MyPlugin *plugin) {
+	// On the main thread, when the plugin is activated for offline rendering. With one processor the workers could only slow it down.
+	RenderWorkers *workers = &plugin->renderWorkers;
+	if (workers->running || plugin->processorCount < 2) return;
+	workers->quit.store(false, std::memory_order_relaxed);
+	SemaphoreInitialise(workers->start);
+	SemaphoreInitialise(workers->done);
+	for (uint32_t i = 0; i < RENDER_TASK_COUNT - 1; i++) ThreadStart(workers->threads[i], PluginRenderWorker, plugin);
+	workers->running = true;
+}
+
+static void PluginRenderWorkersStop(MyPlugin *plugin) {
+	// Called from deactivate and destroy.
+	RenderWorkers *workers = &plugin->renderWorkers;
+	if (!workers->running) return;
+	workers->quit.store(true, std::memory_order_release);
+	for (uint32_t i = 0; i < RENDER_TASK_COUNT - 1; i++) SemaphorePost(workers->start);
+	for (uint32_t i = 0; i < RENDER_TASK_COUNT - 1; i++) ThreadJoin(workers->threads[i]);
+	SemaphoreDestroy(workers->start);
+	SemaphoreDestroy(workers->done);
+	workers->running = false;
+}
+
+static void PluginRenderAudio(MyPlugin *plugin, uint32_t start, uint32_t end, float *outputL, float *outputR) {
+	// With SINE_KERNEL_POLYNOMIAL_9, the output matches the original per-sample scalar loop (sinf of phase * 2 * 3.14159f) to within 1.5e-6 per voice.
+	// Most of that difference comes from the truncated pi in the original; the phases themselves are bit-identical.
+	VoicePool *pool = &plugin->voices;
+	uint32_t waveform = (uint32_t) plugin->parameters[P_WAVEFORM] % WAVEFORM_COUNT;
+	uint32_t oscillator = waveform == WAVEFORM_SINE ? plugin->sineKernel : OSCILLATOR_WAVETABLE;
+	uint32_t unisonCount = (uint32_t) plugin->parameters[P_UNISON_VOICES];
+
+	for (uint32_t index = start; index < end; index++) {
+		outputL[index] = 0.0f;
+	}
+
+	PluginRenderRamp(plugin, P_VOLUME, end);
+	PluginRenderRamp(plugin, P_FILTER_CUTOFF, end);
+
+	VoiceRenderInputs inputs;
+	inputs.gain = plugin->rampBuffers[P_VOLUME] + start;
+	inputs.envelope[0] = PluginEnvelopeCoefficients(plugin, ENVELOPE_CHUNK);
+	inputs.envelope[1] = PluginEnvelopeCoefficients(plugin, (end - start) % ENVELOPE_CHUNK);
+	inputs.wavetable = plugin->wavetables + waveform * WAVETABLE_LEVELS * WAVETABLE_STRIDE;
+	inputs.unisonCount = unisonCount < 1 ? 1 : unisonCount > UNISON_MAXIMUM ? UNISON_MAXIMUM : unisonCount;
+	inputs.filterMode = (uint32_t) plugin->parameters[P_FILTER_MODE] % FILTER_MODE_COUNT;
+	inputs.cutoff = plugin->rampBuffers[P_FILTER_CUTOFF] + start;
+	inputs.filterTable = plugin->filterTable;
+	inputs.filterDamping = 2.0f - 1.98f * plugin->parameters[P_FILTER_RESONANCE];
+	inputs.filterMix[0] = inputs.filterMode == FILTER_HIGH_PASS ? 1.0f : 0.0f;
+	inputs.filterMix[1] = inputs.filterMode == FILTER_HIGH_PASS ? -inputs.filterDamping : inputs.filterMode == FILTER_BAND_PASS ? inputs.filterDamping : 0.0f;
+	inputs.filterMix[2] = inputs.filterMode == FILTER_HIGH_PASS ? -1.0f : inputs.filterMode == FILTER_LOW_PASS ? 1.0f : 0.0f;
+
+	inputs.lfoIncrement = plugin->parameters[P_LFO_RATE] / plugin->sampleRate;
+	inputs.expressionCoefficient[0] = 1.0f - expf(-ENVELOPE_CHUNK / (EXPRESSION_SMOOTHING_TIME * plugin->sampleRate));
+	inputs.expressionCoefficient[1] = 1.0f - expf(-(float) ((end - start) % ENVELOPE_CHUNK) / (EXPRESSION_SMOOTHING_TIME * plugin->sampleRate));
+	inputs.firstFrame = start;
+	inputs.flags = inputs.filterMode != FILTER_OFF ? RENDER_FILTERED : 0;
+
+	for (uint32_t i = 0; i < pool->count; i++) {
+		// Voices are only rendered in stereo while one of them is panned, or is moving towards or waiting for a pan.
+		// The smoothing never quite reaches its target, so it is snapped once close, to let voices panned back to the centre go mono again.
+		float *pan = pool->expression[EXPRESSION_PAN], *target = pool->expressionTarget[EXPRESSION_PAN];
+		if (fabsf(pan[i] - target[i]) < EXPRESSION_SNAP_THRESHOLD) pan[i] = target[i];
+		if (pan[i] != 0.5f || target[i] != 0.5f || pool->expressionPending[EXPRESSION_PAN][i] != 0.5f) inputs.flags |= RENDER_PANNED;
+	}
+
+	for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) {
+		for (uint32_t j = 0; j < MODULATION_SOURCE_COUNT; j++) {
+			uint32_t amount = modulationAmounts[i][j];
+			inputs.modulation[i][j] = amount == MODULATION_UNROUTED ? 0.0f : plugin->parameters[amount];
+		}
+	}
+
+	// Modulation events split the block, so the host's modulation of each voice is constant across it.
+	for (uint32_t i = 0; i < MODULATION_DESTINATION_COUNT; i++) {
+		uint32_t parameter = modulationDestinations[i];
+
+		for (uint32_t j = 0; j < pool->count; j++) {
+			pool->hostModulation[i][j] = plugin->parameterModulation[parameter] + pool->voices[j].parameterOffsets[parameter];
+		}
+	}
+
+	// The volume needs its modulated path while any route to it is set, the host modulates it,
+	// or a voice's offset has not yet settled back to zero from earlier modulation.
+	for (uint32_t j = 0; j < MODULATION_SOURCE_COUNT; j++) {
+		if (inputs.modulation[MODULATION_DESTINATION_VOLUME][j] != 0.0f) inputs.flags |= RENDER_VOLUME_MODULATED;
+	}
+
+	for (uint32_t i = 0; i < pool->count && !(inputs.flags & RENDER_VOLUME_MODULATED); i++) {
+		if (pool->hostModulation[MODULATION_DESTINATION_VOLUME][i] != 0.0f || pool->volumeOffset[i] != 0.0f) inputs.flags |= RENDER_VOLUME_MODULATED;
+	}
+
+	bool stereo = inputs.unisonCount > 1 || (inputs.flags & RENDER_PANNED);
+	uint32_t taskCount = (pool->count + RENDER_TASK_VOICES - 1) / RENDER_TASK_VOICES;
+
+	if (stereo) {
+		for (uint32_t index = start; index < end; index++) {
+			outputR[index] = 0.0f;
+		}
+	}
+
+	bool workersAvailable = plugin->processorCount > 1 && (plugin->hostThreadPool || (plugin->offline && plugin->renderWorkers.running));
+
+	if (taskCount > 1 && workersAvailable && end - start >= RENDER_TASK_MINIMUM_FRAMES) {
+		plugin->renderInputs = &inputs;
+		plugin->renderOscillator = oscillator;
+		plugin->renderFrameCount = end - start;
+
+		bool dispatched = plugin->hostThreadPool && plugin->hostThreadPool->request_exec(plugin->host, taskCount);
+
+		if (!dispatched && plugin->offline && plugin->renderWorkers.running) {
+			PluginRenderWorkersExec(plugin, taskCount);
+		} else if (!dispatched) {
+			// The host could not run them, so run them here, which gives the same output.
+			for (uint32_t task = 0; task < taskCount; task++) {
+				PluginRenderTask(plugin, task);
+			}
+		}
+
+		for (uint32_t task = 0; task < taskCount; task++) {
+			const float *scratchL = plugin->renderScratch + task * 2 * plugin->maximumFrameCount;
+			const float *scratchR = scratchL + plugin->maximumFrameCount;
+			for (uint32_t index = start; index < end; index++) outputL[index] += scratchL[index - start];
+			if (stereo) for (uint32_t index = start; index < end; index++) outputR[index] += scratchR[index - start];
+		}
+	} else {
+		PluginRenderVoices(pool, &inputs, oscillator, 0, pool->count, outputL + start, outputR + start, end - start);
+	}
+
+	if (!stereo) {
+		memcpy(outputR + start, outputL + start, (end - start) * sizeof(float));
+	}
+}
+
+static void FFTAllocate(FFT *fft, uint32_t size) {
+	fft->size = size;
+	fft->twiddleReal = (float *) malloc(size * sizeof(float));
+	fft->twiddleImaginary = (float *) malloc(size * sizeof(float));
+	fft->reversed = (uint32_t *) malloc(size * sizeof(uint32_t));
+
+	for (uint32_t half = 1; half < size; half *= 2) {
+		for (uint32_t k = 0; k < half; k++) {
+			fft->twiddleReal[half + k] = (float) cos(3.14159265358979 * k / half);
+			fft->twiddleImaginary[half + k] = (float) -sin(3.14159265358979 * k / half);
+		}
+	}
+
+	for (uint32_t i = 0, bits = CountTrailingZeros64(size); i < size; i++) {
+		uint32_t reversed = 0;
+		for (uint32_t j = 0; j < bits; j++) reversed |= ((i >> j) & 1) << (bits - 1 - j);
+		fft->reversed[i] = reversed;
+	}
+}
+
+static void FFTFree(FFT *fft) {
+	free(fft->twiddleReal);
+	free(fft->twiddleImaginary);
+	free(fft->reversed);
+	*fft = {};
+}
+
+static void FFTTransform(const FFT *fft, float *real, float *imaginary) {
+	// The forward transform, in place. Swapping the real and imaginary arrays gives the inverse transform, without the 1 / size normalisation.
+	uint32_t size = fft->size;
+
+	for (uint32_t i = 0; i < size; i++) {
+		uint32_t j = fft->reversed[i];
+
+		if (j > i) {
+			float swapReal = real[i], swapImaginary = imaginary[i];
+			real[i] = real[j], imaginary[i] = imaginary[j];
+			real[j] = swapReal, imaginary[j] = swapImaginary;
+		}
+	}
+
+	for (uint32_t half = 1; half < size; half *= 2) {
+		const float *twiddleReal = fft->twiddleReal + half, *twiddleImaginary = fft->twiddleImaginary + half;
+
+		for (uint32_t start = 0; start < size; start += half * 2) {
+			float *aReal = real + start, *aImaginary = imaginary + start;
+			float *bReal = aReal + half, *bImaginary = aImaginary + half;
+
+			if (half >= SIMD_WIDTH) {
+				// The butterflies within a stage are independent, so once they span a vector they are done SIMD_WIDTH at a time.
+				for (uint32_t k = 0; k < half; k += SIMD_WIDTH) {
+					SIMDFloat wr = SIMDLoad(twiddleReal + k), wi = SIMDLoad(twiddleImaginary + k);
+					SIMDFloat br = SIMDLoad(bReal + k), bi = SIMDLoad(bImaginary + k);
+					SIMDFloat ar = SIMDLoad(aReal + k), ai = SIMDLoad(aImaginary + k);
+					SIMDFloat productReal = SIMDSub(SIMDMul(br, wr), SIMDMul(bi, wi));
+					SIMDFloat productImaginary = SIMDMulAdd(br, wi, SIMDMul(bi, wr));
+					SIMDStore(bReal + k, SIMDSub(ar, productReal));
+					SIMDStore(bImaginary + k, SIMDSub(ai, productImaginary));
+					SIMDStore(aReal + k, SIMDAdd(ar, productReal));
+					SIMDStore(aImaginary + k, SIMDAdd(ai, productImaginary));
+				}
+			} else {
+				for (uint32_t k = 0; k < half; k++) {
+					float productReal = bReal[k] * twiddleReal[k] - bImaginary[k] * twiddleImaginary[k];
+					float productImaginary = bReal[k] * twiddleImaginary[k] + bImaginary[k] * twiddleReal[k];
+					bReal[k] = aReal[k] - productReal, bImaginary[k] = aImaginary[k] - productImaginary;
+					aReal[k] += productReal, aImaginary[k] += productImaginary;
+				}
+			}
+		}
+	}
+}
+
+static void ConvolverAllocate(Convolver *convolver, uint32_t blockSize, uint32_t partitionCapacity) {
+	convolver->blockSize = blockSize;
+	convolver->binStride = (blockSize + 1 + 15) / 16 * 16;
+	convolver->partitionCapacity = partitionCapacity ? partitionCapacity : 1;
+	FFTAllocate(&convolver->fft, blockSize * 2);
+	convolver->window = (float *) calloc(blockSize * 2, sizeof(float));
+	convolver->spectraReal = (float *) calloc(convolver->partitionCapacity * convolver->binStride, sizeof(float));
+	convolver->spectraImaginary = (float *) calloc(convolver->partitionCapacity * convolver->binStride, sizeof(float));
+	convolver->real = (float *) calloc(blockSize * 2, sizeof(float));
+	convolver->imaginary = (float *) calloc(blockSize * 2, sizeof(float));
+	convolver->sumReal = (float *) calloc(2 * convolver->binStride, sizeof(float));
+	convolver->sumImaginary = (float *) calloc(2 * convolver->binStride, sizeof(float));
+}
+
+static void ConvolverFree(Convolver *convolver) {
+	FFTFree(&convolver->fft);
+	free(convolver->window);
+	free(convolver->spectraReal);
+	free(convolver->spectraImaginary);
+	free(convolver->real);
+	free(convolver->imaginary);
+	free(convolver->sumReal);
+	free(convolver->sumImaginary);
+	*convolver = {};
+}
+
+static void ConvolverClear(Convolver *convolver) {
+	memset(convolver->window, 0, convolver->blockSize * 2 * sizeof(float));
+	memset(convolver->spectraReal, 0, convolver->partitionCapacity * convolver->binStride * sizeof(float));
+	memset(convolver->spectraImaginary, 0, convolver->partitionCapacity * convolver->binStride * sizeof(float));
+}
+
+static void ConvolverImpulseBuild(const Convolver *convolver, ConvolverImpulse *impulse, const float *samples, uint32_t frameCount, uint32_t start, float *workspace) {
+	// Transforms the stereo impulse response from frame start onwards into partitions, using a workspace of 4 * blockSize floats.
+	// samples is [channel][frameCount]. The partitions are allocated here, so this must not be called on the audio thread.
+	uint32_t blockSize = convolver->blockSize, binStride = convolver->binStride;
+	float *workspaceReal = workspace, *workspaceImaginary = workspace + blockSize * 2;
+	impulse->partitionCount = frameCount > start ? (frameCount - start + blockSize - 1) / blockSize : 0;
+	if (impulse->partitionCount > convolver->partitionCapacity) impulse->partitionCount = convolver->partitionCapacity;
+	impulse->real = (float *) calloc(2 * impulse->partitionCount * binStride + 1, sizeof(float));
+	impulse->imaginary = (float *) calloc(2 * impulse->partitionCount * binStride + 1, sizeof(float));
+
+	for (uint32_t channel = 0; channel < 2; channel++) {
+		for (uint32_t partition = 0; partition < impulse->partitionCount; partition++) {
+			for (uint32_t i = 0; i < blockSize * 2; i++) {
+				uint32_t frame = start + partition * blockSize + i;
+				workspaceReal[i] = i < blockSize && frame < frameCount ? samples[channel * frameCount + frame] / (blockSize * 2) : 0.0f;
+				workspaceImaginary[i] = 0.0f;
+			}
+
+			FFTTransform(&convolver->fft, workspaceReal, workspaceImaginary);
+			float *real = impulse->real + (channel * impulse->partitionCount + partition) * binStride;
+			float *imaginary = impulse->imaginary + (channel * impulse->partitionCount + partition) * binStride;
+			memcpy(real, workspaceReal, (blockSize + 1) * sizeof(float));
+			memcpy(imaginary, workspaceImaginary, (blockSize + 1) * sizeof(float));
+		}
+	}
+}
+
+static void ConvolverImpulseFree(ConvolverImpulse *impulse) {
+	free(impulse->real);
+	free(impulse->imaginary);
+	*impulse = {};
+}
+
+static void ConvolverProcess(Convolver *convolver, const ConvolverImpulse *impulse, const float *input, float *outputL, float *outputR) {
+	// Convolves one block of input, writing one block of each channel's output.
+	uint32_t blockSize = convolver->blockSize, binStride = convolver->binStride;
+	memmove(convolver->window, convolver->window + blockSize, blockSize * sizeof(float));
+	memcpy(convolver->window + blockSize, input, blockSize * sizeof(float));
+	memcpy(convolver->real, convolver->window, blockSize * 2 * sizeof(float));
+	memset(convolver->imaginary, 0, blockSize * 2 * sizeof(float));
+	FFTTransform(&convolver->fft, convolver->real, convolver->imaginary);
+
+	convolver->ring = (convolver->ring + 1) % convolver->partitionCapacity;
+	memcpy(convolver->spectraReal + convolver->ring * binStride, convolver->real, (blockSize + 1) * sizeof(float));
+	memcpy(convolver->spectraImaginary + convolver->ring * binStride, convolver->imaginary, (blockSize + 1) * sizeof(float));
+
+	for (uint32_t channel = 0; channel < 2; channel++) {
+		// The complex multiply-accumulate of each partition with the input block that is its offset behind, across bins.
+		float *sumReal = convolver->sumReal + channel * binStride, *sumImaginary = convolver->sumImaginary + channel * binStride;
+		memset(sumReal, 0, binStride * sizeof(float));
+		memset(sumImaginary, 0, binStride * sizeof(float));
+
+		for (uint32_t partition = 0; partition < impulse->partitionCount; partition++) {
+			uint32_t slot = (convolver->ring + convolver->partitionCapacity - partition) % convolver->partitionCapacity;
+			const float *xReal = convolver->spectraReal + slot * binStride, *xImaginary = convolver->spectraImaginary + slot * binStride;
+			const float *hReal = impulse->real + (channel * impulse->partitionCount + partition) * binStride;
+			const float *hImaginary = impulse->imaginary + (channel * impulse->partitionCount + partition) * binStride;
+
+			for (uint32_t bin = 0; bin < binStride; bin += SIMD_WIDTH) {
+				SIMDFloat ar = SIMDLoad(xReal + bin), ai = SIMDLoad(xImaginary + bin);
+				SIMDFloat br = SIMDLoad(hReal + bin), bi = SIMDLoad(hImaginary + bin);
+				SIMDStore(sumReal + bin, SIMDSub(SIMDMulAdd(ar, br, SIMDLoad(sumReal + bin)), SIMDMul(ai, bi)));
+				SIMDStore(sumImaginary + bin, SIMDMulAdd(ar, bi, SIMDMulAdd(ai, br, SIMDLoad(sumImaginary + bin))));
+			}
+		}
+	}
+
+	// Both channels' outputs are real, so they are inverse transformed together as the real and imaginary parts of one signal.
+	const float *leftReal = convolver->sumReal, *leftImaginary = convolver->sumImaginary;
+	const float *rightReal = convolver->sumReal + binStride, *rightImaginary = convolver->sumImaginary + binStride;
+
+	for (uint32_t bin = 0; bin <= blockSize; bin++) {
+		convolver->real[bin] = leftReal[bin] - rightImaginary[bin];
+		convolver->imaginary[bin] = leftImaginary[bin] + rightReal[bin];
+	}
+
+	for (uint32_t bin = 1; bin < blockSize; bin++) {
+		convolver->real[blockSize * 2 - bin] = leftReal[bin] + rightImaginary[bin];
+		convolver->imaginary[blockSize * 2 - bin] = rightReal[bin] - leftImaginary[bin];
+	}
+
+	FFTTransform(&convolver->fft, convolver->imaginary, convolver->real);
+	memcpy(outputL, convolver->real + blockSize, blockSize * sizeof(float));
+	memcpy(outputR, convolver->imaginary + blockSize, blockSize * sizeof(float));
+}
+
+static void ReverbImpulseBuild(Reverb *reverb, ReverbImpulse *impulse, const float *samples, uint32_t frameCount) {
+	// Loads a stereo impulse response, [channel][frameCount], splitting it between the head and the tail.
+	// This allocates, so it runs on the reverb thread, or on the main thread before the reverb thread starts.
+	ConvolverImpulseBuild(&reverb->head, &impulse->head, samples, frameCount, 0, reverb->impulseWorkspace);
+	ConvolverImpulseBuild(&reverb->tail, &impulse->tail, samples, frameCount, REVERB_TAIL_SIZE * 2, reverb->impulseWorkspace);
+	impulse->frameCount = frameCount;
+}
+
+static void ReverbImpulseGenerate(Reverb *reverb, ReverbImpulse *impulse, float length) {
+	// Exponentially decaying noise, reaching -60 dB after length seconds, with uncorrelated channels.
+	// It is normalised to unit energy, so the wet level does not depend on the length.
+	float maximumLength = REVERB_MAXIMUM_LENGTH * reverb->sampleRate;
+	uint32_t frameCount = (uint32_t) fminf(ceilf(length * reverb->sampleRate), maximumLength);
+	float decay = 6.9078f / (length * reverb->sampleRate);
+	float scale = sqrtf(6.0f * decay);
+	uint32_t random = 1;
+
+	for (uint32_t channel = 0; channel < 2; channel++) {
+		for (uint32_t i = 0; i < frameCount; i++) {
+			random = random * 1664525 + 1013904223;
+			float noise = (random >> 8) * (2.0f / (1 << 24)) - 1.0f;
+			reverb->impulseSamples[channel * frameCount + i] = noise * scale * expf(-decay * i);
+		}
+	}
+
+	ReverbImpulseBuild(reverb, impulse, reverb->impulseSamples, frameCount);
+	impulse->length = length;
+}
+
+static void ReverbImpulseFree(ReverbImpulse *impulse) {
+	ConvolverImpulseFree(&impulse->head);
+	ConvolverImpulseFree(&impulse->tail);
+	impulse->frameCount = 0;
+}
+
+static void ReverbNotify(Reverb *reverb) {
+	// On the reverb thread, after finishing a block or an impulse response.
+	if (reverb->waiting.exchange(false)) SemaphorePost(reverb->finished);
+}
+
+template <class F>
+static void ReverbWaitUntil(Reverb *reverb, F condition) {
+	// On the audio thread, when rendering offline. The flag is set before the condition is checked again, so a notification cannot be missed.
+	while (!condition()) {
+		reverb->waiting.store(true);
+		if (!condition()) SemaphoreWait(reverb->finished);
+		reverb->waiting.store(false);
+	}
+}
+
+static void *ReverbThread(void *argument) {
+	Reverb *reverb = (Reverb *) argument;
+
+	while (true) {
+		SemaphoreWait(reverb->wake);
+		if (reverb->quit.load(std::memory_order_acquire)) break;
+
+		// Read before processing the pending blocks, so that all blocks using the other impulse have been processed before it is replaced.
+		uint32_t published = reverb->impulsePublished.load(std::memory_order_relaxed);
+		bool acknowledged = reverb->impulseAcknowledged.load(std::memory_order_acquire) == published;
+		uint64_t submitted = reverb->tailSubmitted.load(std::memory_order_acquire);
+
+		for (uint64_t block = reverb->tailCompleted.load(std::memory_order_relaxed); block < submitted; block++) {
+			uint32_t slot = block % REVERB_TAIL_SLOTS;
+
+			if (reverb->tailSubmitted.load(std::memory_order_acquire) >= block + REVERB_TAIL_SLOTS) {
+				// The audio thread is already reusing this block's slot, so the block is dropped, and the blocks before it are forgotten.
+				ConvolverClear(&reverb->tail);
+				reverb->tailCompleted.store(block + 1, std::memory_order_release);
+				ReverbNotify(reverb);
+				continue;
+			} else if (reverb->tailClear[slot]) {
+				ConvolverClear(&reverb->tail);
+			}
+
+			ConvolverProcess(&reverb->tail, &reverb->impulses[reverb->tailImpulse[slot]].tail, reverb->tailInput[slot], 
+					reverb->tailOutput[slot], reverb->tailOutput[slot] + REVERB_TAIL_SIZE);
+			reverb->tailCompleted.store(block + 1, std::memory_order_release);
+			ReverbNotify(reverb);
+		}
+
+		float requested = reverb->impulseRequested.load(std::memory_order_relaxed);
+
+		if (acknowledged && requested != reverb->impulses[published].length) {
+			ReverbImpulse *impulse = &reverb->impulses[published ^ 1];
+			ReverbImpulseFree(impulse);
+			ReverbImpulseGenerate(reverb, impulse, requested);
+			reverb->impulsePublished.store(published ^ 1, std::memory_order_release);
+			ReverbNotify(reverb);
+		}
+	}
+
+	return nullptr;
+}
+
+static void ReverbStart(Reverb *reverb, float sampleRate, float length) {
+	// Called from activate. The first impulse response is built here, so the reverb can be used straight away.
+	uint32_t maximumFrames = (uint32_t) ceilf(REVERB_MAXIMUM_LENGTH * sampleRate);
+	reverb->sampleRate = sampleRate;
+	ConvolverAllocate(&reverb->head, REVERB_HEAD_SIZE, REVERB_TAIL_SIZE * 2 / REVERB_HEAD_SIZE);
+	ConvolverAllocate(&reverb->tail, REVERB_TAIL_SIZE, maximumFrames > REVERB_TAIL_SIZE * 2 ? (maximumFrames - REVERB_TAIL_SIZE * 2 + REVERB_TAIL_SIZE - 1) / REVERB_TAIL_SIZE : 0);
+	reverb->impulseSamples = (float *) malloc(2 * maximumFrames * sizeof(float));
+	reverb->impulseWorkspace = (float *) malloc(4 * REVERB_TAIL_SIZE * sizeof(float));
+	reverb->headInput = (float *) calloc(REVERB_HEAD_SIZE, sizeof(float));
+	reverb->headOutput = (float *) calloc(2 * REVERB_HEAD_SIZE, sizeof(float));
+
+	for (uint32_t i = 0; i < REVERB_TAIL_SLOTS; i++) {
+		reverb->tailInput[i] = (float *) calloc(REVERB_TAIL_SIZE, sizeof(float));
+		reverb->tailOutput[i] = (float *) calloc(2 * REVERB_TAIL_SIZE, sizeof(float));
+	}
+
+	ReverbImpulseGenerate(reverb, &reverb->impulses[0], length);
+	reverb->impulseActive = 0;
+	reverb->impulsePublished.store(0, std::memory_order_relaxed);
+	reverb->impulseAcknowledged.store(0, std::memory_order_relaxed);
+	reverb->impulseRequested.store(length, std::memory_order_relaxed);
+	reverb->tailSubmitted.store(0, std::memory_order_relaxed);
+	reverb->tailCompleted.store(0, std::memory_order_relaxed);
+	reverb->bypassed = true;
+	reverb->quit.store(false, std::memory_order_relaxed);
+	reverb->waiting.store(false, std::memory_order_relaxed);
+	SemaphoreInitialise(reverb->wake);
+	SemaphoreInitialise(reverb->finished);
+	ThreadStart(reverb->thread, ReverbThread, reverb);
+	reverb->running = true;
+}
+
+static void ReverbStop(Reverb *reverb) {
+	// Called from deactivate and destroy.
+	if (!reverb->running) return;
+	reverb->quit.store(true, std::memory_order_release);
+	SemaphorePost(reverb->wake);
+	ThreadJoin(reverb->thread);
+	SemaphoreDestroy(reverb->wake);
+	SemaphoreDestroy(reverb->finished);
+	ConvolverFree(&reverb->head);
+	ConvolverFree(&reverb->tail);
+	ReverbImpulseFree(&reverb->impulses[0]);
+	ReverbImpulseFree(&reverb->impulses[1]);
+	free(reverb->impulseSamples);
+	free(reverb->impulseWorkspace);
+	free(reverb->headInput);
+	free(reverb->headOutput);
+
+	for (uint32_t i = 0; i < REVERB_TAIL_SLOTS; i++) {
+		free(reverb->tailInput[i]);
+		free(reverb->tailOutput[i]);
+	}
+
+	reverb->impulseSamples = reverb->impulseWorkspace = reverb->headInput = reverb->headOutput = nullptr;
+	reverb->impulses[0].length = reverb->impulses[1].length = 0.0f;
+	reverb->running = false;
+}
+
+static void ReverbSetLength(Reverb *reverb, float length) {
+	// On the audio thread. The reverb thread builds the new impulse response, and the switch happens at a later tail block.
+	if (!reverb->running) return;
+	reverb->impulseRequested.store(length, std::memory_order_relaxed);
+	SemaphorePost(reverb->wake);
+}
+
+static bool ReverbRinging(Reverb *reverb) {
+	// Whether the wet signal may still be audible after the input fell silent.
+	return !reverb->bypassed && reverb->silentFrames < reverb->impulses[reverb->impulseActive].frameCount + REVERB_HEAD_SIZE + REVERB_TAIL_SIZE;
+}
+
+static void ReverbProcess(Reverb *reverb, float *outputL, float *outputR, const float *mix, uint32_t frameCount) {
+	// Adds the wet signal of the sum of the channels to the output, scaled by the per-sample mix.
+	// All of the head and tail block boundaries fall on multiples of REVERB_HEAD_SIZE, so the block is processed in pieces that end on them.
+	bool silent = true;
+
+	for (uint32_t i = 0; i < frameCount && silent; i++) {
+		silent = outputL[i] == 0.0f && outputR[i] == 0.0f;
+	}
+
+	reverb->silentFrames = !silent ? 0 : reverb->silentFrames < 0x7FFFFFFF ? reverb->silentFrames + frameCount : reverb->silentFrames;
+
+	if (reverb->bypassed) {
+		// The reverb state is stale, so clear it. The reverb thread clears the tail convolver when it gets the first block.
+		ConvolverClear(&reverb->head);
+		memset(reverb->headInput, 0, REVERB_HEAD_SIZE * sizeof(float));
+		memset(reverb->headOutput, 0, 2 * REVERB_HEAD_SIZE * sizeof(float));
+		reverb->frames = 0;
+		reverb->tailFirst = reverb->tailSubmitted.load(std::memory_order_relaxed);
+		reverb->bypassed = false;
+		reverb->silentFrames = 0;
+	}
+
+	for (uint32_t i = 0; i < frameCount; ) {
+		uint32_t headFill = reverb->frames % REVERB_HEAD_SIZE;
+		uint32_t count = frameCount - i < REVERB_HEAD_SIZE - headFill ? frameCount - i : REVERB_HEAD_SIZE - headFill;
+		uint64_t tailBlock = reverb->tailFirst + reverb->frames / REVERB_TAIL_SIZE;
+		float *tailInput = reverb->tailInput[tailBlock % REVERB_TAIL_SLOTS] + reverb->frames % REVERB_TAIL_SIZE;
+		const float *tailOutputL = nullptr, *tailOutputR = nullptr;
+
+		if (reverb->frames >= REVERB_HEAD_SIZE + REVERB_TAIL_SIZE * 2) {
+			// Tail block n is played starting REVERB_HEAD_SIZE frames after block n + 2 starts.
+			uint64_t played = reverb->frames - REVERB_HEAD_SIZE - REVERB_TAIL_SIZE * 2;
+			uint64_t playedBlock = reverb->tailFirst + played / REVERB_TAIL_SIZE;
+
+			if (played % REVERB_TAIL_SIZE == 0) {
+				if (reverb->offline) {
+					ReverbWaitUntil(reverb, [&] { return reverb->tailCompleted.load(std::memory_order_acquire) > playedBlock; });
+				}
+
+				reverb->tailReady = reverb->tailCompleted.load(std::memory_order_acquire) > playedBlock;
+				if (!reverb->tailReady) reverb->tailBlocksMissed.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			if (reverb->tailReady) {
+				tailOutputL = reverb->tailOutput[playedBlock % REVERB_TAIL_SLOTS] + played % REVERB_TAIL_SIZE;
+				tailOutputR = tailOutputL + REVERB_TAIL_SIZE;
+			}
+		}
+
+		for (uint32_t j = 0; j < count; j++) {
+			float input = 0.5f * (outputL[i + j] + outputR[i + j]);
+			float wetL = reverb->headOutput[headFill + j] + (tailOutputL ? tailOutputL[j] : 0.0f);
+			float wetR = reverb->headOutput[REVERB_HEAD_SIZE + headFill + j] + (tailOutputR ? tailOutputR[j] : 0.0f);
+			reverb->headInput[headFill + j] = tailInput[j] = input;
+			outputL[i + j] += wetL * mix[i + j];
+			outputR[i + j] += wetR * mix[i + j];
+		}
+
+		reverb->frames += count;
+		i += count;
+
+		if (reverb->frames % REVERB_TAIL_SIZE == 0) {
+			// Offline, the switch waits until the requested impulse response is built, so the output does not depend on the reverb thread's timing.
+			ReverbWaitUntil(reverb, [&] {
+				uint32_t published = reverb->impulsePublished.load(std::memory_order_acquire);
+
+				if (published != reverb->impulseActive) {
+					reverb->impulseActive = published;
+					reverb->impulseAcknowledged.store(published, std::memory_order_release);
+					SemaphorePost(reverb->wake);
+				}
+
+				return !reverb->offline || reverb->impulses[reverb->impulseActive].length == reverb->impulseRequested.load(std::memory_order_relaxed);
+			});
+
+			reverb->tailImpulse[tailBlock % REVERB_TAIL_SLOTS] = reverb->impulseActive;
+			reverb->tailClear[tailBlock % REVERB_TAIL_SLOTS] = tailBlock == reverb->tailFirst;
+			reverb->tailSubmitted.store(tailBlock + 1, std::memory_order_release);
+			SemaphorePost(reverb->wake);
+		}
+
+		if (reverb->frames % REVERB_HEAD_SIZE == 0) {
+			ConvolverProcess(&reverb->head, &reverb->impulses[reverb->impulseActive].head, reverb->headInput, 
+					reverb->headOutput, reverb->headOutput + REVERB_HEAD_SIZE);
+		}
+	}
+}
+
+static void DelayAllocate(Delay *delay, float sampleRate) {
+	// Called from activate. The buffers hold the longest modulated delay and the samples either side of it needed for interpolation.
+	uint32_t frames = (uint32_t) ceilf((DELAY_MAXIMUM_TIME + DELAY_MAXIMUM_DEPTH) * sampleRate) + 4, size = DELAY_MINIMUM_FRAMES;
+	while (size < frames) size *= 2;
+	delay->sampleRate = sampleRate;
+	delay->buffers[0] = (float *) calloc(size, sizeof(float));
+	delay->buffers[1] = (float *) calloc(size, sizeof(float));
+	delay->mask = size - 1;
+	delay->bypassed = true;
+}
+
+static void DelayFree(Delay *delay) {
+	free(delay->buffers[0]);
+	free(delay->buffers[1]);
+	delay->buffers[0] = delay->buffers[1] = nullptr;
+}
+
+static bool DelayRinging(Delay *delay) {
+	// Once the input and output have been quiet for the length of the buffer, everything in it is quiet too.
+	return !delay->bypassed && delay->quietFrames <= delay->mask;
+}
+
+static inline SIMDFloat DelayRead(const float *buffer, SIMDInt position, SIMDFloat offset, SIMDInt mask) {
+	// Reads each lane offset frames before its position, with Catmull-Rom interpolation between the four nearest samples.
+	SIMDFloat whole = SIMDFloor(offset);
+	SIMDFloat t = SIMDSub(SIMDAdd(whole, SIMDBroadcast(1.0f)), offset);
+	SIMDInt index = SIMDIntSub(position, SIMDIntAdd(SIMDTruncate(whole), SIMDIntBroadcast(1)));
+	SIMDFloat xm1 = SIMDGather(buffer, SIMDIntAnd(SIMDIntSub(index, SIMDIntBroadcast(1)), mask));
+	SIMDFloat x0 = SIMDGather(buffer, SIMDIntAnd(index, mask));
+	SIMDFloat x1 = SIMDGather(buffer, SIMDIntAnd(SIMDIntAdd(index, SIMDIntBroadcast(1)), mask));
+	SIMDFloat x2 = SIMDGather(buffer, SIMDIntAnd(SIMDIntAdd(index, SIMDIntBroadcast(2)), mask));
+	SIMDFloat c1 = SIMDMul(SIMDBroadcast(0.5f), SIMDSub(x1, xm1));
+	SIMDFloat c2 = SIMDAdd(SIMDSub(xm1, SIMDMul(SIMDBroadcast(2.5f), x0)), SIMDSub(SIMDAdd(x1, x1), SIMDMul(SIMDBroadcast(0.5f), x2)));
+	SIMDFloat c3 = SIMDMulAdd(SIMDBroadcast(0.5f), SIMDSub(x2, xm1), SIMDMul(SIMDBroadcast(1.5f), SIMDSub(x0, x1)));
+	return SIMDMulAdd(SIMDMulAdd(SIMDMulAdd(c3, t, c2), t, c1), t, x0);
+}
+
+static void DelayProcess(Delay *delay, float *outputL, float *outputR, const float *mix, const float *time, const float *feedback, 
+		float depth, float rate, uint32_t frameCount) {
+	// Adds the wet signal to the output in place, scaled by the per-sample mix; the delay time and feedback are also per-sample.
+	// The two channels are modulated a quarter of a cycle apart. Frames are processed SIMD_WIDTH at a time, 
+	// and the delay is never shorter than DELAY_MINIMUM_FRAMES, so the samples they read do not depend on each other.
+	if (delay->bypassed) {
+		// The buffers are stale, so clear them.
+		memset(delay->buffers[0], 0, (delay->mask + 1) * sizeof(float));
+		memset(delay->buffers[1], 0, (delay->mask + 1) * sizeof(float));
+		delay->quietFrames = 0;
+		delay->bypassed = false;
+	}
+
+	static const float laneIndices[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	SIMDFloat lane = SIMDLoad(laneIndices);
+	SIMDInt mask = SIMDIntBroadcast(delay->mask);
+	SIMDFloat sampleRate = SIMDBroadcast(delay->sampleRate), minimum = SIMDBroadcast(DELAY_MINIMUM_FRAMES);
+	SIMDFloat depthFrames = SIMDBroadcast(0.5f * depth * DELAY_MAXIMUM_DEPTH * delay->sampleRate);
+	SIMDFloat lfoIncrement = SIMDBroadcast(rate / delay->sampleRate);
+	SIMDFloat energy = SIMDBroadcast(0.0f);
+
+	for (uint32_t i = 0; i < frameCount; i += SIMD_WIDTH) {
+		uint32_t count = frameCount - i < SIMD_WIDTH ? frameCount - i : SIMD_WIDTH;
+		float *chunkL = outputL + i, *chunkR = outputR + i;
+		const float *chunkMix = mix + i, *chunkTime = time + i, *chunkFeedback = feedback + i;
+		float padded[5][SIMD_WIDTH] = {};
+
+		if (count < SIMD_WIDTH) {
+			// The last frames of a block that is not a multiple of SIMD_WIDTH.
+			memcpy(padded[0], chunkL, count * sizeof(float)), chunkL = padded[0];
+			memcpy(padded[1], chunkR, count * sizeof(float)), chunkR = padded[1];
+			memcpy(padded[2], chunkMix, count * sizeof(float)), chunkMix = padded[2];
+			memcpy(padded[3], chunkTime, count * sizeof(float)), chunkTime = padded[3];
+			memcpy(padded[4], chunkFeedback, count * sizeof(float)), chunkFeedback = padded[4];
+		}
 
-// Parameters.
-#define P_VOLUME (0)
-#define P_COUNT (1)
+		SIMDFloat phaseL = SIMDMulAdd(lane, lfoIncrement, SIMDBroadcast(delay->lfoPhase));
+		SIMDFloat phaseR = SIMDAdd(phaseL, SIMDBroadcast(0.25f));
+		phaseL = SIMDSub(phaseL, SIMDFloor(phaseL));
+		phaseR = SIMDSub(phaseR, SIMDFloor(phaseR));
+		SIMDFloat base = SIMDMax(SIMDMul(SIMDLoad(chunkTime), sampleRate), minimum);
+		SIMDFloat offsetL = SIMDMulAdd(SIMDAdd(OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(phaseL), SIMDBroadcast(1.0f)), depthFrames, base);
+		SIMDFloat offsetR = SIMDMulAdd(SIMDAdd(OscillatorSine<SINE_KERNEL_POLYNOMIAL_5>(phaseR), SIMDBroadcast(1.0f)), depthFrames, base);
+
+		SIMDInt position = SIMDIntAdd(SIMDIntBroadcast((int32_t) delay->position), SIMDTruncate(lane));
+		SIMDFloat wetL = DelayRead(delay->buffers[0], position, offsetL, mask);
+		SIMDFloat wetR = DelayRead(delay->buffers[1], position, offsetR, mask);
+		SIMDFloat dryL = SIMDLoad(chunkL), dryR = SIMDLoad(chunkR);
+		SIMDFloat chunkFeedbackVector = SIMDLoad(chunkFeedback), chunkMixVector = SIMDLoad(chunkMix);
+		energy = SIMDMulAdd(wetL, wetL, SIMDMulAdd(wetR, wetR, SIMDMulAdd(dryL, dryL, SIMDMulAdd(dryR, dryR, energy))));
+
+		float writeL[SIMD_WIDTH], writeR[SIMD_WIDTH];
+		SIMDStore(writeL, SIMDMulAdd(wetL, chunkFeedbackVector, dryL));
+		SIMDStore(writeR, SIMDMulAdd(wetR, chunkFeedbackVector, dryR));
+		SIMDStore(chunkL, SIMDMulAdd(wetL, chunkMixVector, dryL));
+		SIMDStore(chunkR, SIMDMulAdd(wetR, chunkMixVector, dryR));
+
+		for (uint32_t j = 0; j < count; j++) {
+			delay->buffers[0][(delay->position + j) & delay->mask] = writeL[j];
+			delay->buffers[1][(delay->position + j) & delay->mask] = writeR[j];
+		}
 
-// GUI size.
-#define GUI_WIDTH (300)
-#define GUI_HEIGHT (200)
+		if (count < SIMD_WIDTH) {
+			memcpy(outputL + i, padded[0], count * sizeof(float));
+			memcpy(outputR + i, padded[1], count * sizeof(float));
+		}
 
-struct Voice {
-	bool held;
-	int32_t noteID;
-	int16_t channel, key;
+		delay->position += count;
+		delay->lfoPhase += count * rate / delay->sampleRate;
+		delay->lfoPhase -= floorf(delay->lfoPhase);
+	}
 
-	float phase;
-	float parameterOffsets[P_COUNT];
-};
+	bool quiet = SIMDSum(energy) < DELAY_SILENCE_THRESHOLD * DELAY_SILENCE_THRESHOLD;
+	delay->quietFrames = !quiet ? 0 : delay->quietFrames <= delay->mask ? delay->quietFrames + frameCount : delay->quietFrames;
+}
 
-struct MyPlugin {
-	clap_plugin_t plugin;
-	const clap_host_t *host;
-	float sampleRate;
-	Array<Voice> voices;
-	float parameters[P_COUNT], mainParameters[P_COUNT];
-	bool changed[P_COUNT], mainChanged[P_COUNT];
-	bool gestureStart[P_COUNT], gestureEnd[P_COUNT];
-	Mutex syncParameters;
-	struct GUI *gui;
-	const clap_host_posix_fd_support_t *hostPOSIXFDSupport;
-	const clap_host_timer_support_t *hostTimerSupport;
-	const clap_host_params_t *hostParams;
-	bool mouseDragging;
-	uint32_t mouseDraggingParameter;
-	int32_t mouseDragOriginX, mouseDragOriginY;
-	float mouseDragOriginValue;
-	clap_id timerID;
-};
+static bool PluginRampZero(MyPlugin *plugin, uint32_t parameter) {
+	// Whether a smoothed parameter is zero for the whole block, once its ramp has been rendered.
+	ParameterRamp *ramp = &plugin->ramps[parameter];
+	return !ramp->remaining && ramp->value == 0.0f && plugin->rampBuffers[parameter][0] == 0.0f;
+}
 
-static float FloatClamp01(float x) {
-	return x >= 1.0f ? 1.0f : x <= 0.0f ? 0.0f : x;
+static bool PluginEffectsRinging(MyPlugin *plugin) {
+	return DelayRinging(&plugin->delay) || ReverbRinging(&plugin->reverb);
 }
 
-static void PluginProcessEvent(MyPlugin *plugin, const clap_event_header_t *event) {
-	if (event->space_id == CLAP_CORE_EVENT_SPACE_ID) {
-		if (event->type == CLAP_EVENT_NOTE_ON || event->type == CLAP_EVENT_NOTE_OFF || event->type == CLAP_EVENT_NOTE_CHOKE) {
-			const clap_event_note_t *noteEvent = (const clap_event_note_t *) event;
+static void PluginProcessEffects(MyPlugin *plugin, float *outputL, float *outputR, uint32_t frameCount) {
+	// The master bus effects, after the voices have been rendered for the whole block.
+	PluginRenderRamp(plugin, P_DELAY_MIX, frameCount);
+	PluginRenderRamp(plugin, P_REVERB_MIX, frameCount);
+
+	if (PluginRampZero(plugin, P_DELAY_MIX)) {
+		plugin->delay.bypassed = true;
+	} else {
+		PluginRenderRamp(plugin, P_DELAY_TIME, frameCount);
+		PluginRenderRamp(plugin, P_DELAY_FEEDBACK, frameCount);
+		DelayProcess(&plugin->delay, outputL, outputR, plugin->rampBuffers[P_DELAY_MIX], plugin->rampBuffers[P_DELAY_TIME], 
+				plugin->rampBuffers[P_DELAY_FEEDBACK], plugin->parameters[P_DELAY_DEPTH], plugin->parameters[P_DELAY_RATE], frameCount);
+	}
 
-			for (int i = 0; i < plugin->voices.Length(); i++) {
-				Voice *voice = &plugin->voices[i];
+	if (PluginRampZero(plugin, P_REVERB_MIX)) {
+		plugin->reverb.bypassed = true;
+	} else {
+		ReverbProcess(&plugin->reverb, outputL, outputR, plugin->rampBuffers[P_REVERB_MIX], frameCount);
+	}
+}
 
-				if ((noteEvent->key == -1 || voice->key == noteEvent->key)
-						&& (noteEvent->note_id == -1 || voice->noteID == noteEvent->note_id)
-						&& (noteEvent->channel == -1 || voice->channel == noteEvent->channel)) {
-					if (event->type == CLAP_EVENT_NOTE_CHOKE) {
-						plugin->voices.Delete(i--);
-					} else {
-						voice->held = false;
-					}
-				}
-			}
+static void PluginRecordTiming(MyPlugin *plugin, uint64_t start, uint32_t frameCount) {
+	// On the audio thread, at the end of process.
+	if (!frameCount) return;
+	float load = (TimeGetNanoseconds() - start) * 1e-9f * plugin->sampleRate / frameCount;
+	uint32_t bucket = load < TIMING_BUCKET_COUNT * TIMING_BUCKET_WIDTH ? (uint32_t) (load / TIMING_BUCKET_WIDTH) : TIMING_BUCKET_COUNT - 1;
+	if (bucket >= TIMING_BUCKET_COUNT) bucket = TIMING_BUCKET_COUNT - 1;
+	plugin->timingBuckets[bucket].store(plugin->timingBuckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 
-			if (event->type == CLAP_EVENT_NOTE_ON) {
-				Voice voice = { 
-					.held = true, 
-					.noteID = noteEvent->note_id, 
-					.channel = noteEvent->channel, 
-					.key = noteEvent->key,
-					.phase = 0.0f,
-					.parameterOffsets = {},
-				};
+	if (load > plugin->timingMaximum.load(std::memory_order_relaxed)) {
+		plugin->timingMaximum.store(load, std::memory_order_relaxed);
+	}
 
-				plugin->voices.Add(voice);
-			}
-		} else if (event->type == CLAP_EVENT_PARAM_VALUE) {
-			const clap_event_param_value_t *valueEvent = (const clap_event_param_value_t *) event;
-			uint32_t i = (uint32_t) valueEvent->param_id;
-			MutexAcquire(plugin->syncParameters);
-			plugin->parameters[i] = valueEvent->value;
-			plugin->changed[i] = true;
-			MutexRelease(plugin->syncParameters);
-		} else if (event->type == CLAP_EVENT_PARAM_MOD) {
-			const clap_event_param_mod_t *modEvent = (const clap_event_param_mod_t *) event;
+	if (load > plugin->timingWindowMaximum) {
+		plugin->timingWindowMaximum = load;
+	}
 
-			for (int i = 0; i < plugin->voices.Length(); i++) {
-				Voice *voice = &plugin->voices[i];
+	plugin->timingWindowFrames += frameCount;
 
-				if ((modEvent->key == -1 || voice->key == modEvent->key)
-						&& (modEvent->note_id == -1 || voice->noteID == modEvent->note_id)
-						&& (modEvent->channel == -1 || voice->channel == modEvent->channel)) {
-					voice->parameterOffsets[modEvent->param_id] = modEvent->amount;
-					break;
-				}
-			}
-		}
+	if (plugin->timingWindowFrames >= plugin->sampleRate) {
+		plugin->timingSecondMaximum.store(plugin->timingWindowMaximum, std::memory_order_relaxed);
+		plugin->timingWindowMaximum = 0.0f;
+		plugin->timingWindowFrames = 0;
 	}
 }
 
-static void PluginRenderAudio(MyPlugin *plugin, uint32_t start, uint32_t end, float *outputL, float *outputR) {
-	for (uint32_t index = start; index < end; index++) {
-		float sum = 0.0f;
+static void PluginWriteTimingLog(MyPlugin *plugin, const char *path) {
+	// On the main thread, from destroy.
+	FILE *file = fopen(path, "ab");
+	if (!file) return;
+	uint32_t total = 0, overloads = 0;
 
-		for (int i = 0; i < plugin->voices.Length(); i++) {
-			Voice *voice = &plugin->voices[i];
-			if (!voice->held) continue;
-			float volume = FloatClamp01(plugin->parameters[P_VOLUME] + voice->parameterOffsets[P_VOLUME]);
-			sum += sinf(voice->phase * 2.0f * 3.14159f) * 0.2f * volume;
-			voice->phase += 440.0f * exp2f((voice->key - 57.0f) / 12.0f) / plugin->sampleRate;
-			voice->phase -= floorf(voice->phase);
-		}
+	for (uint32_t i = 0; i < TIMING_BUCKET_COUNT; i++) {
+		uint32_t count = plugin->timingBuckets[i].load(std::memory_order_relaxed);
+		total += count;
+		if (i * TIMING_BUCKET_WIDTH >= 1.0f) overloads += count;
+	}
 
-		outputL[index] = sum;
-		outputR[index] = sum;
+	fprintf(file, "Process timing: %u calls, %u overloads, maximum load %.1f%%\n", 
+			total, overloads, plugin->timingMaximum.load(std::memory_order_relaxed) * 100.0f);
+
+	for (uint32_t i = 0; i < TIMING_BUCKET_COUNT; i++) {
+		uint32_t count = plugin->timingBuckets[i].load(std::memory_order_relaxed);
+		if (!count) continue;
+		if (i == TIMING_BUCKET_COUNT - 1) fprintf(file, "    %5.0f%% and up  %u\n", i * TIMING_BUCKET_WIDTH * 100.0f, count);
+		else fprintf(file, "    %5.0f%% - %3.0f%%  %u\n", i * TIMING_BUCKET_WIDTH * 100.0f, (i + 1) * TIMING_BUCKET_WIDTH * 100.0f, count);
 	}
+
+	fclose(file);
 }
 
 static void PluginPaintRectangle(MyPlugin *plugin, uint32_t *bits, uint32_t l, uint32_t r, uint32_t t, uint32_t b, uint32_t border, uint32_t fill) {
@@ -171,19 +2943,71 @@ static void PluginPaintRectangle(MyPlugin *plugin, uint32_t *bits, uint32_t l, u
 	}
 }
 
+static void PluginPaintNumber(MyPlugin *plugin, uint32_t *bits, uint32_t x, uint32_t y, uint32_t number, uint32_t color) {
+	// Draws the number in a 3x5 pixel font, doubled in size, with its left edge at x.
+	static const uint16_t glyphs[10] = { 0x7B6F, 0x2C97, 0x73E7, 0x72CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249, 0x7BEF, 0x7BCF };
+	char digits[16];
+	int digitCount = snprintf(digits, sizeof(digits), "%u", number);
+
+	for (int i = 0; i < digitCount; i++) {
+		uint16_t glyph = glyphs[digits[i] - '0'];
+
+		for (uint32_t j = 0; j < 15; j++) {
+			if (~glyph & (1 << (14 - j))) continue;
+			uint32_t l = x + i * 8 + (j % 3) * 2, t = y + (j / 3) * 2;
+			if (l + 2 > GUI_WIDTH || t + 2 > GUI_HEIGHT) continue;
+			PluginPaintRectangle(plugin, bits, l, l + 2, t, t + 2, color, color);
+		}
+	}
+}
+
 static void PluginPaint(MyPlugin *plugin, uint32_t *bits) {
 	PluginPaintRectangle(plugin, bits, 0, GUI_WIDTH, 0, GUI_HEIGHT, 0xC0C0C0, 0xC0C0C0);
 	PluginPaintRectangle(plugin, bits, 10, 40, 10, 40, 0x000000, 0xC0C0C0);
 	PluginPaintRectangle(plugin, bits, 10, 40, 10 + 30 * (1.0f - plugin->mainParameters[P_VOLUME]), 40, 0x000000, 0x000000);
+
+	// Voices stolen since the plugin was created.
+	PluginPaintNumber(plugin, bits, 10, 50, plugin->mainVoicesStolen, 0x000000);
+
+	// Silent blocks that were skipped.
+	PluginPaintNumber(plugin, bits, 10, 65, plugin->mainBlocksSkipped, 0x000000);
+
+	// The process timing histogram, with a logarithmic count axis. Overloads are red, to the right of the grey budget line.
+	uint32_t histogramLeft = 60, histogramBottom = 100, barWidth = 6;
+	PluginPaintRectangle(plugin, bits, histogramLeft + barWidth * (uint32_t) (1.0f / TIMING_BUCKET_WIDTH) - 1, 
+			histogramLeft + barWidth * (uint32_t) (1.0f / TIMING_BUCKET_WIDTH), histogramBottom - 80, histogramBottom, 0x808080, 0x808080);
+
+	for (uint32_t i = 0; i < TIMING_BUCKET_COUNT; i++) {
+		uint32_t count = plugin->mainTimingBuckets[i];
+		if (!count) continue;
+		uint32_t height = 4 * (uint32_t) log2f(count + 1.0f);
+		if (height > 80) height = 80;
+		uint32_t color = i * TIMING_BUCKET_WIDTH >= 1.0f ? 0xC00000 : 0x000000;
+		PluginPaintRectangle(plugin, bits, histogramLeft + i * barWidth, histogramLeft + (i + 1) * barWidth - 1, histogramBottom - height, histogramBottom, color, color);
+	}
+
+	// The highest load in the last second, as a percentage.
+	PluginPaintNumber(plugin, bits, histogramLeft, histogramBottom + 10, (uint32_t) (plugin->mainTimingSecondMaximum * 100.0f), 
+			plugin->mainTimingSecondMaximum >= 1.0f ? 0xC00000 : 0x000000);
+}
+
+static void PluginSendMainEvent(MyPlugin *plugin, uint32_t type, uint32_t parameter) {
+	if (type == PARAMETER_VALUE) {
+		// Values sent before the audio thread picks them up are coalesced, so only the latest reaches the host.
+		plugin->mainSnapshots[parameter].store(plugin->mainParameters[parameter], std::memory_order_relaxed);
+		plugin->mainChanged.Mark(parameter);
+	} else {
+		// Gestures carry the value at the time they were sent, so the audio thread can deliver it before a gesture end.
+		// The queue only fills up if the host stops calling process and flush, and gestures are then dropped.
+		plugin->mainGestures.Push({ type, parameter, plugin->mainParameters[parameter] });
+	}
 }
 
 static void PluginProcessMouseDrag(MyPlugin *plugin, int32_t x, int32_t y) {
 	if (plugin->mouseDragging) {
 		float newValue = FloatClamp01(plugin->mouseDragOriginValue + (plugin->mouseDragOriginY - y) * 0.01f);
-		MutexAcquire(plugin->syncParameters);
 		plugin->mainParameters[plugin->mouseDraggingParameter] = newValue;
-		plugin->mainChanged[plugin->mouseDraggingParameter] = true;
-		MutexRelease(plugin->syncParameters);
+		PluginSendMainEvent(plugin, PARAMETER_VALUE, plugin->mouseDraggingParameter);
 
 		if (plugin->hostParams && plugin->hostParams->request_flush) {
 			plugin->hostParams->request_flush(plugin->host);
@@ -199,9 +3023,7 @@ static void PluginProcessMousePress(MyPlugin *plugin, int32_t x, int32_t y) {
 		plugin->mouseDragOriginY = y;
 		plugin->mouseDragOriginValue = plugin->mainParameters[P_VOLUME];
 
-		MutexAcquire(plugin->syncParameters);
-		plugin->gestureStart[plugin->mouseDraggingParameter] = true;
-		MutexRelease(plugin->syncParameters);
+		PluginSendMainEvent(plugin, PARAMETER_GESTURE_BEGIN, plugin->mouseDraggingParameter);
 
 		if (plugin->hostParams && plugin->hostParams->request_flush) {
 			plugin->hostParams->request_flush(plugin->host);
@@ -211,9 +3033,7 @@ static void PluginProcessMousePress(MyPlugin *plugin, int32_t x, int32_t y) {
 
 static void PluginProcessMouseRelease(MyPlugin *plugin) {
 	if (plugin->mouseDragging) {
-		MutexAcquire(plugin->syncParameters);
-		plugin->gestureEnd[plugin->mouseDraggingParameter] = true;
-		MutexRelease(plugin->syncParameters);
+		PluginSendMainEvent(plugin, PARAMETER_GESTURE_END, plugin->mouseDraggingParameter);
 
 		if (plugin->hostParams && plugin->hostParams->request_flush) {
 			plugin->hostParams->request_flush(plugin->host);
@@ -223,73 +3043,63 @@ static void PluginProcessMouseRelease(MyPlugin *plugin) {
 	}
 }
 
-static void PluginSyncMainToAudio(MyPlugin *plugin, const clap_output_events_t *out) {
-	MutexAcquire(plugin->syncParameters);
-
-	for (uint32_t i = 0; i < P_COUNT; i++) {
-		if (plugin->gestureStart[i]) {
-			plugin->gestureStart[i] = false;
+static void PluginSendParameterValue(MyPlugin *plugin, uint32_t parameter, float value, const clap_output_events_t *out) {
+	PluginApplyParameter(plugin, parameter, value, 0);
+
+	clap_event_param_value_t event = {};
+	event.header.size = sizeof(event);
+	event.header.time = 0;
+	event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+	event.header.type = CLAP_EVENT_PARAM_VALUE;
+	event.header.flags = 0;
+	event.param_id = parameter;
+	event.cookie = NULL;
+	event.note_id = -1;
+	event.port_index = -1;
+	event.channel = -1;
+	event.key = -1;
+	event.value = value;
+	out->try_push(out, &event.header);
+}
 
-			clap_event_param_gesture_t event = {};
-			event.header.size = sizeof(event);
-			event.header.time = 0;
-			event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-			event.header.type = CLAP_EVENT_PARAM_GESTURE_BEGIN;
-			event.header.flags = 0;
-			event.param_id = i;
-			out->try_push(out, &event.header);
-		}
+static void PluginSyncMainToAudio(MyPlugin *plugin, const clap_output_events_t *out) {
+	ParameterEvent parameterEvent;
 
-		if (plugin->mainChanged[i]) {
-			plugin->parameters[i] = plugin->mainParameters[i];
-			plugin->mainChanged[i] = false;
+	// Gestures only come from the GUI, so they stay queued while rendering offline. Values are still applied, so that state loads take effect.
+	while (!plugin->offline && plugin->mainGestures.Pop(&parameterEvent)) {
+		uint32_t i = parameterEvent.parameter;
 
-			clap_event_param_value_t event = {};
-			event.header.size = sizeof(event);
-			event.header.time = 0;
-			event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-			event.header.type = CLAP_EVENT_PARAM_VALUE;
-			event.header.flags = 0;
-			event.param_id = i;
-			event.cookie = NULL;
-			event.note_id = -1;
-			event.port_index = -1;
-			event.channel = -1;
-			event.key = -1;
-			event.value = plugin->parameters[i];
-			out->try_push(out, &event.header);
+		if (parameterEvent.type == PARAMETER_GESTURE_END && plugin->mainChanged.Test(i)) {
+			// Deliver the gesture's final value before its end. The change stays marked, so a newer value is still sent below.
+			PluginSendParameterValue(plugin, i, parameterEvent.value, out);
 		}
 
-		if (plugin->gestureEnd[i]) {
-			plugin->gestureEnd[i] = false;
-
-			clap_event_param_gesture_t event = {};
-			event.header.size = sizeof(event);
-			event.header.time = 0;
-			event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-			event.header.type = CLAP_EVENT_PARAM_GESTURE_END;
-			event.header.flags = 0;
-			event.param_id = i;
-			out->try_push(out, &event.header);
-		}
+		clap_event_param_gesture_t event = {};
+		event.header.size = sizeof(event);
+		event.header.time = 0;
+		event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+		event.header.type = parameterEvent.type == PARAMETER_GESTURE_BEGIN ? CLAP_EVENT_PARAM_GESTURE_BEGIN : CLAP_EVENT_PARAM_GESTURE_END;
+		event.header.flags = 0;
+		event.param_id = i;
+		out->try_push(out, &event.header);
 	}
 
-	MutexRelease(plugin->syncParameters);
+	plugin->mainChanged.Drain([&] (uint32_t i) {
+		float value = plugin->mainSnapshots[i].load(std::memory_order_relaxed);
+		if (value != plugin->parameters[i]) PluginSendParameterValue(plugin, i, value, out);
+	});
 }
 
 static bool PluginSyncAudioToMain(MyPlugin *plugin) {
 	bool anyChanged = false;
-	MutexAcquire(plugin->syncParameters);
 
-	for (uint32_t i = 0; i < P_COUNT; i++) {
-		if (plugin->changed[i]) {
-			plugin->mainParameters[i] = plugin->parameters[i];
-			plugin->changed[i] = false;
-			anyChanged = true;
-		}
-	}
+	plugin->audioChanged.Drain([&] (uint32_t i) {
+		// Ignore changes that are about to be overwritten by the main thread's own.
+		if (plugin->mainChanged.Test(i)) return;
+		plugin->mainParameters[i] = plugin->parameterSnapshots[i].load(std::memory_order_relaxed);
+		anyChanged = true;
+	});
 
-	MutexRelease(plugin->syncParameters);
 	return anyChanged;
 }
 
@@ -320,7 +3130,7 @@ static const clap_plugin_note_ports_t extensionNotePorts = {
 	.get = [] (const clap_plugin_t *plugin, uint32_t index, bool isInput, clap_note_port_info_t *info) -> bool {
 		if (!isInput || index) return false;
 		info->id = 0;
-		info->supported_dialects = CLAP_NOTE_DIALECT_CLAP;
+		info->supported_dialects = CLAP_NOTE_DIALECT_CLAP | CLAP_NOTE_DIALECT_MIDI | CLAP_NOTE_DIALECT_MIDI2;
 		info->preferred_dialect = CLAP_NOTE_DIALECT_CLAP;
 		snprintf(info->name, sizeof(info->name), "%s", "Note Port");
 		return true;
@@ -359,6 +3169,188 @@ static const clap_plugin_params_t extensionParams = {
 			information->default_value = 0.5f;
 			strcpy(information->name, "Volume");
 			return true;
+		} else if (index == P_VOICE_STEALING) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_STEPPED;
+			information->min_value = 0.0f;
+			information->max_value = VOICE_STEAL_COUNT - 1;
+			information->default_value = VOICE_STEAL_OLDEST;
+			strcpy(information->name, "Voice Stealing");
+			return true;
+		} else if (index == P_ATTACK || index == P_DECAY || index == P_RELEASE) {
+			static const char *names[] = { "Attack", "Decay", "", "Release" };
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 10.0f;
+			information->default_value = index == P_ATTACK ? 0.005f : index == P_DECAY ? 0.2f : 0.1f;
+			strcpy(information->name, names[index - P_ATTACK]);
+			return true;
+		} else if (index == P_SUSTAIN) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 1.0f;
+			strcpy(information->name, "Sustain");
+			return true;
+		} else if (index == P_WAVEFORM) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+			information->min_value = 0.0f;
+			information->max_value = WAVEFORM_COUNT - 1;
+			information->default_value = WAVEFORM_SINE;
+			strcpy(information->name, "Waveform");
+			return true;
+		} else if (index == P_UNISON_VOICES) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+			information->min_value = 1.0f;
+			information->max_value = UNISON_MAXIMUM;
+			information->default_value = 1.0f;
+			strcpy(information->name, "Unison Voices");
+			return true;
+		} else if (index == P_UNISON_DETUNE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.2f;
+			strcpy(information->name, "Unison Detune");
+			return true;
+		} else if (index == P_UNISON_SPREAD) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.5f;
+			strcpy(information->name, "Unison Spread");
+			return true;
+		} else if (index == P_FILTER_MODE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED;
+			information->min_value = 0.0f;
+			information->max_value = FILTER_MODE_COUNT - 1;
+			information->default_value = FILTER_OFF;
+			strcpy(information->name, "Filter Mode");
+			return true;
+		} else if (index == P_FILTER_CUTOFF) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE | CLAP_PARAM_IS_MODULATABLE_PER_NOTE_ID;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 1.0f;
+			strcpy(information->name, "Filter Cutoff");
+			return true;
+		} else if (index == P_FILTER_RESONANCE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.3f;
+			strcpy(information->name, "Filter Resonance");
+			return true;
+		} else if (index == P_FILTER_ENVELOPE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = -1.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.0f;
+			strcpy(information->name, "Filter Envelope");
+			return true;
+		} else if (index == P_REVERB_MIX) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.0f;
+			strcpy(information->name, "Reverb Mix");
+			return true;
+		} else if (index == P_REVERB_LENGTH) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.1f;
+			information->max_value = REVERB_MAXIMUM_LENGTH;
+			information->default_value = 2.0f;
+			strcpy(information->name, "Reverb Length");
+			return true;
+		} else if (index == P_DELAY_MIX) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.0f;
+			strcpy(information->name, "Delay Mix");
+			return true;
+		} else if (index == P_DELAY_TIME) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.001f;
+			information->max_value = DELAY_MAXIMUM_TIME;
+			information->default_value = 0.3f;
+			strcpy(information->name, "Delay Time");
+			return true;
+		} else if (index == P_DELAY_FEEDBACK) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = DELAY_MAXIMUM_FEEDBACK;
+			information->default_value = 0.3f;
+			strcpy(information->name, "Delay Feedback");
+			return true;
+		} else if (index == P_DELAY_DEPTH) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.0f;
+			information->max_value = 1.0f;
+			information->default_value = 0.0f;
+			strcpy(information->name, "Delay Modulation Depth");
+			return true;
+		} else if (index == P_DELAY_RATE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.05f;
+			information->max_value = 10.0f;
+			information->default_value = 0.5f;
+			strcpy(information->name, "Delay Modulation Rate");
+			return true;
+		} else if (index == P_LFO_RATE) {
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = 0.05f;
+			information->max_value = 20.0f;
+			information->default_value = 5.0f;
+			strcpy(information->name, "LFO Rate");
+			return true;
+		} else if (index == P_LFO_VOLUME || index == P_LFO_CUTOFF || index == P_VELOCITY_VOLUME || index == P_VELOCITY_CUTOFF || index == P_BRIGHTNESS_CUTOFF) {
+			static const char *names[] = { "LFO to Volume", "LFO to Filter Cutoff", "Velocity to Volume", "Velocity to Filter Cutoff", "Brightness to Filter Cutoff" };
+			memset(information, 0, sizeof(clap_param_info_t));
+			information->id = index;
+			information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+			information->min_value = -1.0f;
+			information->max_value = 1.0f;
+			information->default_value = index == P_BRIGHTNESS_CUTOFF ? 0.25f : 0.0f;
+			strcpy(information->name, names[index - P_LFO_VOLUME]);
+			return true;
 		} else {
 			return false;
 		}
@@ -368,16 +3360,44 @@ static const clap_plugin_params_t extensionParams = {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
 		uint32_t i = (uint32_t) id;
 		if (i >= P_COUNT) return false;
-		MutexAcquire(plugin->syncParameters);
-		*value = plugin->mainChanged[i] ? plugin->mainParameters[i] : plugin->parameters[i];
-		MutexRelease(plugin->syncParameters);
+		bool mainPending = plugin->mainChanged.Test(i);
+		*value = mainPending ? plugin->mainParameters[i] : plugin->parameterSnapshots[i].load(std::memory_order_relaxed);
 		return true;
 	},
 
 	.value_to_text = [] (const clap_plugin_t *_plugin, clap_id id, double value, char *display, uint32_t size) {
 		uint32_t i = (uint32_t) id;
 		if (i >= P_COUNT) return false;
-		snprintf(display, size, "%f", value);
+
+		if (i == P_VOICE_STEALING) {
+			static const char *policies[VOICE_STEAL_COUNT] = { "Oldest", "Quietest", "Same key" };
+			snprintf(display, size, "%s", policies[(uint32_t) value % VOICE_STEAL_COUNT]);
+		} else if (i == P_WAVEFORM) {
+			static const char *waveforms[WAVEFORM_COUNT] = { "Sine", "Saw", "Square", "Triangle" };
+			snprintf(display, size, "%s", waveforms[(uint32_t) value % WAVEFORM_COUNT]);
+		} else if (i == P_ATTACK || i == P_DECAY || i == P_RELEASE || i == P_REVERB_LENGTH || i == P_DELAY_TIME) {
+			snprintf(display, size, "%.3f s", value);
+		} else if (i == P_UNISON_VOICES) {
+			snprintf(display, size, "%u", (uint32_t) value);
+		} else if (i == P_UNISON_DETUNE) {
+			snprintf(display, size, "%.0f cents", value * 100.0);
+		} else if (i == P_FILTER_MODE) {
+			static const char *modes[FILTER_MODE_COUNT] = { "Off", "Low-pass", "Band-pass", "High-pass" };
+			snprintf(display, size, "%s", modes[(uint32_t) value % FILTER_MODE_COUNT]);
+		} else if (i == P_FILTER_CUTOFF) {
+			snprintf(display, size, "%.0f Hz", FILTER_MINIMUM_FREQUENCY * exp2(FILTER_OCTAVES * value));
+		} else if (i == P_FILTER_ENVELOPE || i == P_LFO_CUTOFF || i == P_VELOCITY_CUTOFF || i == P_BRIGHTNESS_CUTOFF) {
+			snprintf(display, size, "%+.1f octaves", FILTER_OCTAVES * value);
+		} else if (i == P_LFO_VOLUME || i == P_VELOCITY_VOLUME) {
+			snprintf(display, size, "%+.0f%%", value * 100.0);
+		} else if (i == P_DELAY_DEPTH) {
+			snprintf(display, size, "%.1f ms", value * DELAY_MAXIMUM_DEPTH * 1000.0);
+		} else if (i == P_DELAY_RATE || i == P_LFO_RATE) {
+			snprintf(display, size, "%.2f Hz", value);
+		} else {
+			snprintf(display, size, "%f", value);
+		}
+
 		return true;
 	},
 
@@ -388,12 +3408,19 @@ static const clap_plugin_params_t extensionParams = {
 
 	.flush = [] (const clap_plugin_t *_plugin, const clap_input_events_t *in, const clap_output_events_t *out) {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
-		const uint32_t eventCount = in->size(in);
+		RealtimeEnter();
 		PluginSyncMainToAudio(plugin, out);
 
-		for (uint32_t eventIndex = 0; eventIndex < eventCount; eventIndex++) {
-			PluginProcessEvent(plugin, in->get(in, eventIndex));
+		EventDecoder *decoder = &plugin->eventDecoder;
+		EventDecoderStart(decoder, in);
+
+		for (const clap_event_header_t *event; (event = EventDecoderPeek(decoder)); decoder->position++) {
+			PluginProcessEvent(plugin, event, out);
 		}
+
+		// No audio is rendered, so the ramps continue from here at the start of the next block.
+		PluginFinishRamps(plugin, 0);
+		RealtimeLeave();
 	},
 };
 
@@ -406,14 +3433,45 @@ static const clap_plugin_state_t extensionState = {
 
 	.load = [] (const clap_plugin_t *_plugin, const clap_istream_t *stream) -> bool {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
-		MutexAcquire(plugin->syncParameters);
-		bool success = sizeof(float) * P_COUNT == stream->read(stream, plugin->mainParameters, sizeof(float) * P_COUNT);
-		for (uint32_t i = 0; i < P_COUNT; i++) plugin->mainChanged[i] = true;
-		MutexRelease(plugin->syncParameters);
+		int64_t bytes = 0, bytesRead;
+
+		while (bytes < (int64_t) sizeof(float) * P_COUNT 
+				&& (bytesRead = stream->read(stream, (uint8_t *) plugin->mainParameters + bytes, sizeof(float) * P_COUNT - bytes)) > 0) {
+			bytes += bytesRead;
+		}
+
+		// States saved before a parameter was added are shorter, and those parameters keep their current value.
+		bool success = bytes > 0 && bytes % sizeof(float) == 0;
+		for (uint32_t i = 0; i < P_COUNT; i++) PluginSendMainEvent(plugin, PARAMETER_VALUE, i);
 		return success;
 	},
 };
 
+static uint32_t PluginTail(MyPlugin *plugin) {
+	// After the last note is released, its envelope reaches ENVELOPE_THRESHOLD and the voice is reclaimed after the release time.
+	// The delay then repeats until its feedback has decayed below DELAY_SILENCE_THRESHOLD, 
+	// and the reverb rings for the length of its impulse response, after its latency.
+	// The host may ask for the tail on the audio thread, so this only reads the parameter snapshots, which are safe from either thread.
+	auto parameter = [plugin] (uint32_t i) { return plugin->parameterSnapshots[i].load(std::memory_order_relaxed); };
+	uint32_t tail = (uint32_t) ceilf(parameter(P_RELEASE) * plugin->sampleRate) + ENVELOPE_CHUNK;
+
+	if (parameter(P_DELAY_MIX) > 0.0f) {
+		float feedback = parameter(P_DELAY_FEEDBACK);
+		float repeats = feedback > 0.0f ? ceilf(logf(DELAY_SILENCE_THRESHOLD) / logf(feedback)) : 0.0f;
+		float time = parameter(P_DELAY_TIME) + parameter(P_DELAY_DEPTH) * DELAY_MAXIMUM_DEPTH;
+		tail += (uint32_t) ceilf(time * plugin->sampleRate * (repeats + 1.0f));
+	}
+
+	if (parameter(P_REVERB_MIX) > 0.0f) tail += (uint32_t) ceilf(parameter(P_REVERB_LENGTH) * plugin->sampleRate) + REVERB_HEAD_SIZE;
+	return tail;
+}
+
+static const clap_plugin_tail_t extensionTail = {
+	.get = [] (const clap_plugin_t *_plugin) -> uint32_t {
+		return PluginTail((MyPlugin *) _plugin->plugin_data);
+	},
+};
+
 #if defined(_WIN32)
 #include "gui_w32.cpp"
 #elif defined(__linux__)
@@ -504,9 +3562,70 @@ static const clap_plugin_timer_support_t extensionTimerSupport = {
 	.on_timer = [] (const clap_plugin_t *_plugin, clap_id timerID) {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
 
-		if (plugin->gui && PluginSyncAudioToMain(plugin)) {
+		bool repaint = PluginSyncAudioToMain(plugin);
+		uint32_t voicesStolen = plugin->voicesStolen.load(std::memory_order_relaxed);
+		uint32_t blocksSkipped = plugin->blocksSkipped.load(std::memory_order_relaxed);
+
+		if (plugin->mainVoicesStolen != voicesStolen || plugin->mainBlocksSkipped != blocksSkipped) {
+			plugin->mainVoicesStolen = voicesStolen;
+			plugin->mainBlocksSkipped = blocksSkipped;
+			repaint = true;
+		}
+
+		for (uint32_t i = 0; i < TIMING_BUCKET_COUNT; i++) {
+			uint32_t count = plugin->timingBuckets[i].load(std::memory_order_relaxed);
+			if (count != plugin->mainTimingBuckets[i]) repaint = true;
+			plugin->mainTimingBuckets[i] = count;
+		}
+
+		float timingSecondMaximum = plugin->timingSecondMaximum.load(std::memory_order_relaxed);
+
+		if (plugin->mainTimingSecondMaximum != timingSecondMaximum) {
+			plugin->mainTimingSecondMaximum = timingSecondMaximum;
+			repaint = true;
+		}
+
+		if (plugin->gui && repaint) {
 			GUIPaint(plugin, true);
 		}
+
+		if (plugin->hostTail && plugin->hostTail->changed && plugin->mainTail != PluginTail(plugin)) {
+			plugin->mainTail = PluginTail(plugin);
+			plugin->hostTail->changed(plugin->host);
+		}
+	},
+};
+
+// Offline rendering makes the output repeatable, not faster. The reverb waits for its late tail blocks instead of dropping them,
+// and with more than one processor the voices are spread across worker threads. The internal block sizes are the same as in realtime,
+// since the event quantum and envelope chunks set the timing of the output, and REVERB_HEAD_SIZE sets the wet latency.
+// Larger blocks come from the host: sub-blocks span the host's block wherever there are no events, up to maximumFramesCount.
+static const clap_plugin_render_t extensionRender = {
+	.has_hard_realtime_requirement = [] (const clap_plugin_t *_plugin) -> bool {
+		return false;
+	},
+
+	.set = [] (const clap_plugin_t *_plugin, clap_plugin_render_mode mode) -> bool {
+		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
+		if (mode != CLAP_RENDER_REALTIME && mode != CLAP_RENDER_OFFLINE) return false;
+		if (mode == CLAP_RENDER_OFFLINE && plugin->voices.capacity) PluginRenderWorkersStart(plugin);
+
+		if (mode == CLAP_RENDER_REALTIME && plugin->renderMode.load(std::memory_order_relaxed) == CLAP_RENDER_OFFLINE) {
+			// Parameter changes from the host were not marked while rendering offline, so refresh them all.
+			for (uint32_t i = 0; i < P_COUNT; i++) plugin->audioChanged.Mark(i);
+		}
+
+		plugin->renderMode.store(mode, std::memory_order_release);
+		return true;
+	},
+};
+
+static const clap_plugin_thread_pool_t extensionThreadPool = {
+	.exec = [] (const clap_plugin_t *_plugin, uint32_t taskIndex) {
+		// On the host's worker threads, while process waits for them.
+		RealtimeEnter();
+		PluginRenderTask((MyPlugin *) _plugin->plugin_data, taskIndex);
+		RealtimeLeave();
 	},
 };
 
@@ -520,15 +3639,20 @@ static const clap_plugin_t pluginClass = {
 		plugin->hostPOSIXFDSupport = (const clap_host_posix_fd_support_t *) plugin->host->get_extension(plugin->host, CLAP_EXT_POSIX_FD_SUPPORT);
 		plugin->hostTimerSupport = (const clap_host_timer_support_t *) plugin->host->get_extension(plugin->host, CLAP_EXT_TIMER_SUPPORT);
 		plugin->hostParams = (const clap_host_params_t *) plugin->host->get_extension(plugin->host, CLAP_EXT_PARAMS);
-
-		MutexInitialise(plugin->syncParameters);
+		plugin->hostTail = (const clap_host_tail_t *) plugin->host->get_extension(plugin->host, CLAP_EXT_TAIL);
+		plugin->hostThreadPool = (const clap_host_thread_pool_t *) plugin->host->get_extension(plugin->host, CLAP_EXT_THREAD_POOL);
 
 		for (uint32_t i = 0; i < P_COUNT; i++) {
 			clap_param_info_t information = {};
 			extensionParams.get_info(_plugin, i, &information);
 			plugin->mainParameters[i] = plugin->parameters[i] = information.default_value;
+			plugin->parameterSnapshots[i].store(plugin->parameters[i], std::memory_order_relaxed);
+			plugin->mainSnapshots[i].store(plugin->parameters[i], std::memory_order_relaxed);
 		}
 
+		PluginSnapRamps(plugin);
+		PluginResetChannels(plugin);
+
 		if (plugin->hostTimerSupport && plugin->hostTimerSupport->register_timer) {
 			plugin->hostTimerSupport->register_timer(plugin->host, 200, &plugin->timerID);
 		}
@@ -538,8 +3662,15 @@ static const clap_plugin_t pluginClass = {
 
 	.destroy = [] (const clap_plugin *_plugin) {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
-		plugin->voices.Free();
-		MutexDestroy(plugin->syncParameters);
+		const char *timingLogPath = getenv(TIMING_LOG_VARIABLE);
+		if (timingLogPath && timingLogPath[0]) PluginWriteTimingLog(plugin, timingLogPath);
+		VoicePoolFree(&plugin->voices);
+		DelayFree(&plugin->delay);
+		ReverbStop(&plugin->reverb);
+		PluginRenderWorkersStop(plugin);
+		for (uint32_t i = 0; i < P_COUNT; i++) free(plugin->rampBuffers[i]);
+		free(plugin->renderScratch);
+		WavetablesRelease();
 
 		if (plugin->hostTimerSupport && plugin->hostTimerSupport->register_timer) {
 			plugin->hostTimerSupport->unregister_timer(plugin->host, plugin->timerID);
@@ -551,10 +3682,41 @@ static const clap_plugin_t pluginClass = {
 	.activate = [] (const clap_plugin *_plugin, double sampleRate, uint32_t minimumFramesCount, uint32_t maximumFramesCount) -> bool {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
 		plugin->sampleRate = sampleRate;
+		plugin->sineKernel = SINE_KERNEL_DEFAULT;
+		plugin->eventQuantum = EVENT_QUANTUM;
+		plugin->maximumFrameCount = maximumFramesCount;
+		plugin->processorCount = ProcessorCount() > 1 ? (uint32_t) ProcessorCount() : 1;
+		PluginBuildTuningTable(plugin);
+		FilterTableBuild(plugin->filterTable, plugin->sampleRate);
+		VoicePoolAllocate(&plugin->voices, VOICE_POOL_CAPACITY);
+		DelayAllocate(&plugin->delay, sampleRate);
+		ReverbStart(&plugin->reverb, sampleRate, plugin->parameters[P_REVERB_LENGTH]);
+		plugin->renderScratch = (float *) malloc(RENDER_TASK_COUNT * 2 * maximumFramesCount * sizeof(float));
+		if (plugin->renderMode.load(std::memory_order_relaxed) == CLAP_RENDER_OFFLINE) PluginRenderWorkersStart(plugin);
+
+		for (uint32_t i = 0; i < P_COUNT; i++) {
+			if (parameterSmoothing[i] != PARAMETER_SMOOTHING_NONE) {
+				plugin->rampBuffers[i] = (float *) calloc(maximumFramesCount, sizeof(float));
+			}
+		}
+
+		PluginSnapRamps(plugin);
 		return true;
 	},
 
 	.deactivate = [] (const clap_plugin *_plugin) {
+		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
+		VoicePoolFree(&plugin->voices);
+		DelayFree(&plugin->delay);
+		ReverbStop(&plugin->reverb);
+		PluginRenderWorkersStop(plugin);
+		free(plugin->renderScratch);
+		plugin->renderScratch = nullptr;
+
+		for (uint32_t i = 0; i < P_COUNT; i++) {
+			free(plugin->rampBuffers[i]);
+			plugin->rampBuffers[i] = nullptr;
+		}
 	},
 
 	.start_processing = [] (const clap_plugin *_plugin) -> bool {
@@ -566,35 +3728,80 @@ static const clap_plugin_t pluginClass = {
 
 	.reset = [] (const clap_plugin *_plugin) {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
-		plugin->voices.Free();
+		if (plugin->voices.capacity) VoicePoolClear(&plugin->voices);
+		PluginResetChannels(plugin);
+		plugin->delay.bypassed = true;
+		plugin->reverb.bypassed = true;
+		PluginSnapRamps(plugin);
 	},
 
 	.process = [] (const clap_plugin *_plugin, const clap_process_t *process) -> clap_process_status {
 		MyPlugin *plugin = (MyPlugin *) _plugin->plugin_data;
+		uint64_t startTime = TimeGetNanoseconds();
+		RealtimeEnter();
 
 		assert(process->audio_outputs_count == 1);
 		assert(process->audio_inputs_count == 0);
 
 		const uint32_t frameCount = process->frames_count;
-		const uint32_t inputEventCount = process->in_events->size(process->in_events);
-		uint32_t eventIndex = 0;
-		uint32_t nextEventFrame = inputEventCount ? 0 : frameCount;
-
+		assert(frameCount <= plugin->maximumFrameCount);
+		EventDecoder *decoder = &plugin->eventDecoder;
+		EventDecoderStart(decoder, process->in_events);
+		const uint32_t inputEventCount = decoder->inputCount;
+		const clap_event_header_t *event = EventDecoderPeek(decoder);
+		uint32_t nextEventFrame = event ? 0 : frameCount;
+
+		plugin->offline = plugin->renderMode.load(std::memory_order_acquire) == CLAP_RENDER_OFFLINE;
+		plugin->reverb.offline = plugin->offline;
 		PluginSyncMainToAudio(plugin, process->out_events);
 
+		if (!plugin->voices.count && !inputEventCount && !PluginEffectsRinging(plugin)) {
+			// Nothing can make a sound until a note starts, so skip rendering and let the host stop calling process until it has events.
+			// The effects have died away, so they are cleared before they are next used.
+			plugin->delay.bypassed = true;
+			plugin->reverb.bypassed = true;
+			memset(process->audio_outputs[0].data32[0], 0, frameCount * sizeof(float));
+			memset(process->audio_outputs[0].data32[1], 0, frameCount * sizeof(float));
+			process->audio_outputs[0].constant_mask = 0x3;
+			PluginFinishRamps(plugin, frameCount);
+			plugin->blocksSkipped.fetch_add(1, std::memory_order_relaxed);
+			PluginRecordTiming(plugin, startTime, frameCount);
+			RealtimeLeave();
+			return CLAP_PROCESS_SLEEP;
+		}
+
 		for (uint32_t i = 0; i < frameCount; ) {
-			while (eventIndex < inputEventCount && nextEventFrame == i) {
-				const clap_event_header_t *event = process->in_events->get(process->in_events, eventIndex);
+			while (event && nextEventFrame == i) {
+				// Smoothed parameter values are applied to their ramps at the event's own time, and note expressions in the chunk containing it,
+				// so they do not split the block. Other events split it at the start of their sub-block.
+				bool splitsBlock = event->space_id != CLAP_CORE_EVENT_SPACE_ID || event->type != CLAP_EVENT_NOTE_EXPRESSION;
+
+				if (!splitsBlock && event->time >= i + ENVELOPE_CHUNK) {
+					// A note expression splits the block at the start of its chunk, when a voice it applies to still waits for an earlier one.
+					uint32_t chunkFrame = i + (event->time - i) / ENVELOPE_CHUNK * ENVELOPE_CHUNK;
+
+					if (PluginExpressionWaiting(plugin, (const clap_event_note_expression_t *) event, chunkFrame)) {
+						nextEventFrame = chunkFrame;
+						break;
+					}
+				}
 
-				if (event->time != i) {
-					nextEventFrame = event->time;
+				if (event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_PARAM_VALUE) {
+					clap_id parameter = ((const clap_event_param_value_t *) event)->param_id;
+					splitsBlock = plugin->eventQuantum == 1 || parameter >= P_COUNT || parameterSmoothing[parameter] == PARAMETER_SMOOTHING_NONE;
+				}
+				uint32_t eventFrame = event->time - event->time % plugin->eventQuantum;
+
+				if (eventFrame > i && splitsBlock) {
+					nextEventFrame = eventFrame;
 					break;
 				}
 
-				PluginProcessEvent(plugin, event);
-				eventIndex++;
+				PluginProcessEvent(plugin, event, process->out_events);
+				decoder->position++;
+				event = EventDecoderPeek(decoder);
 
-				if (eventIndex == inputEventCount) {
+				if (!event) {
 					nextEventFrame = frameCount;
 					break;
 				}
@@ -604,27 +3811,28 @@ static const clap_plugin_t pluginClass = {
 			i = nextEventFrame;
 		}
 
-		for (int i = 0; i < plugin->voices.Length(); i++) {
-			Voice *voice = &plugin->voices[i];
+		PluginProcessEffects(plugin, process->audio_outputs[0].data32[0], process->audio_outputs[0].data32[1], frameCount);
+		PluginFinishRamps(plugin, frameCount);
 
-			if (!voice->held) {
-				clap_event_note_t event = {};
-				event.header.size = sizeof(event);
-				event.header.time = 0;
-				event.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-				event.header.type = CLAP_EVENT_NOTE_END;
-				event.header.flags = 0;
-				event.key = voice->key;
-				event.note_id = voice->noteID;
-				event.channel = voice->channel;
-				event.port_index = 0;
-				process->out_events->try_push(process->out_events, &event.header);
+		bool anyHeld = false;
 
-				plugin->voices.Delete(i--);
+		for (uint32_t i = 0; i < plugin->voices.count; i++) {
+			Voice *voice = &plugin->voices.voices[i];
+
+			if (plugin->voices.envelopeStage[i] == ENVELOPE_FINISHED) {
+				PluginSendNoteEnd(voice, process->out_events);
+				VoicePoolRemove(&plugin->voices, i--);
+			} else if (voice->held) {
+				anyHeld = true;
 			}
 		}
 
-		return CLAP_PROCESS_CONTINUE;
+		// Once every voice is released, the host can use the tail to decide when to stop processing.
+		process->audio_outputs[0].constant_mask = 0;
+		bool sleep = !plugin->voices.count && !PluginEffectsRinging(plugin);
+		PluginRecordTiming(plugin, startTime, frameCount);
+		RealtimeLeave();
+		return sleep ? CLAP_PROCESS_SLEEP : anyHeld ? CLAP_PROCESS_CONTINUE : CLAP_PROCESS_CONTINUE_IF_NOT_QUIET;
 	},
 
 	.get_extension = [] (const clap_plugin *plugin, const char *id) -> const void * {
@@ -635,6 +3843,9 @@ static const clap_plugin_t pluginClass = {
 		if (0 == strcmp(id, CLAP_EXT_POSIX_FD_SUPPORT)) return &extensionPOSIXFDSupport;
 		if (0 == strcmp(id, CLAP_EXT_TIMER_SUPPORT   )) return &extensionTimerSupport;
 		if (0 == strcmp(id, CLAP_EXT_STATE           )) return &extensionState;
+		if (0 == strcmp(id, CLAP_EXT_TAIL            )) return &extensionTail;
+		if (0 == strcmp(id, CLAP_EXT_THREAD_POOL     )) return &extensionThreadPool;
+		if (0 == strcmp(id, CLAP_EXT_RENDER          )) return &extensionRender;
 		return nullptr;
 	},
 
@@ -660,6 +3871,7 @@ static const clap_plugin_factory_t pluginFactory = {
 		plugin->host = host;
 		plugin->plugin = pluginClass;
 		plugin->plugin.plugin_data = plugin;
+		plugin->wavetables = WavetablesAcquire();
 		return &plugin->plugin;
 	},
 };
@@ -668,10 +3880,14 @@ extern "C" const clap_plugin_entry_t clap_entry = {
 	.clap_version = CLAP_VERSION_INIT,
 
 	.init = [] (const char *path) -> bool { 
+		SineTableInitialise();
+		MutexInitialise(wavetablesMutex);
 		return true; 
 	},
 
-	.deinit = [] () {},
+	.deinit = [] () {
+		MutexDestroy(wavetablesMutex);
+	},
 
 	.get_factory = [] (const char *factoryID) -> const void * {
 		return strcmp(factoryID, CLAP_PLUGIN_FACTORY_ID) ? nullptr : &pluginFactory;